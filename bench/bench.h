@@ -0,0 +1,41 @@
+#pragma once
+// Shared helpers for the headless engine benchmarks (miko_bench).
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+int benchDelete(const std::vector<std::string>& args);
+int benchSwap(const std::vector<std::string>& args);
+int benchExtract(const std::vector<std::string>& args);
+int benchVerify(const std::vector<std::string>& args);
+int benchWrite(const std::vector<std::string>& args);
+int benchLargeFiles(const std::vector<std::string>& args);
+int benchDurability(const std::vector<std::string>& args);
+int benchStored(const std::vector<std::string>& args);
+
+// Returns the value following `name`, or `fallback` when absent
+std::string benchOption(const std::vector<std::string>& args, const std::string& name, const std::string& fallback);
+uint64_t benchOptionU64(const std::vector<std::string>& args, const std::string& name, uint64_t fallback);
+bool benchFlag(const std::vector<std::string>& args, const std::string& name);
+// Parses a comma separated list such as "1,2,4,8"
+std::vector<unsigned> benchThreadList(const std::vector<std::string>& args, const std::string& fallback);
+// Heap allocations made so far by this process (miko_bench replaces operator new)
+uint64_t benchAllocations();
+// Peak resident memory of this process in bytes, and a reset of that mark so each row of a
+// sweep is measured on its own; Linux only, 0 elsewhere
+uint64_t benchPeakMemory();
+void benchResetPeakMemory();
+// Scratch directory under --dir (default: system temp), removed and recreated
+std::filesystem::path benchScratchDir(const std::vector<std::string>& args, const std::string& name);
+
+class BenchTimer {
+public:
+    BenchTimer() : start(std::chrono::steady_clock::now()) {}
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+private:
+    std::chrono::steady_clock::time_point start;
+};
@@ -0,0 +1,79 @@
+// Uninstall throughput: files/s of DeletionPool over a synthetic install tree, next to a
+// single-threaded std::filesystem::remove_all of the same tree, and the latency of the
+// rename-into-trash mode.
+#include "bench.h"
+#include "core/DeletionPool.h"
+#include "core/Trash.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Mirrors the shape of an IDE install: a few top-level components, nested folders,
+// mostly small files
+InstallManifest makeTree(const fs::path& root, uint64_t fileCount) {
+    InstallManifest m;
+    std::string payload(2048, 'x');
+    for (uint64_t i = 0; i < fileCount; ++i) {
+        char rel[96];
+        snprintf(rel, sizeof(rel), "c%02u/d%03u/e%02u/f%06llu.dat", (unsigned)(i % 8), (unsigned)((i / 8) % 250),
+                 (unsigned)((i / 2000) % 32), (unsigned long long)i);
+        fs::path p = manifestPath(root, rel);
+        std::error_code ec;
+        fs::create_directories(p.parent_path(), ec);
+        size_t size = (size_t)(i * 7919 % payload.size());
+        std::ofstream(p, std::ios::binary).write(payload.data(), (std::streamsize)size);
+        m.addFile(rel, size);
+    }
+    return m;
+}
+
+} // namespace
+
+int benchDelete(const std::vector<std::string>& args) {
+    uint64_t files = benchOptionU64(args, "--files", 50000);
+    std::vector<unsigned> threadCounts = benchThreadList(args, "1,2,4,8");
+
+    std::cout << "delete: " << files << " files per run" << std::endl;
+    {
+        fs::path root = benchScratchDir(args, "miko_bench_delete");
+        makeTree(root, files);
+        BenchTimer t;
+        std::error_code ec;
+        fs::remove_all(root, ec);
+        double s = t.seconds();
+        std::cout << "  remove_all (baseline)  " << s << " s  " << (uint64_t)(files / s) << " files/s" << std::endl;
+    }
+    for (unsigned threads : threadCounts) {
+        fs::path root = benchScratchDir(args, "miko_bench_delete");
+        InstallManifest built = makeTree(root, files);
+        built.save(root / MIKO_MANIFEST_FILE);
+
+        BenchTimer t;
+        InstallManifest manifest;
+        manifest.load(root / MIKO_MANIFEST_FILE);
+        DeletionPool pool(threads);
+        bool ok = pool.run(root, manifest);
+        double s = t.seconds();
+        std::cout << "  manifest, " << threads << " workers  " << s << " s  " << (uint64_t)(files / s)
+                  << " files/s" << (ok ? "" : "  (failures)") << std::endl;
+        std::error_code ec;
+        fs::remove_all(root, ec);
+    }
+    {
+        // Background mode: time until control returns to the UI, i.e. the rename alone
+        fs::path root = benchScratchDir(args, "miko_bench_delete");
+        makeTree(root, files);
+        BenchTimer t;
+        fs::path trashed = Trash::moveToTrash(root);
+        double s = t.seconds();
+        std::cout << "  rename into trash       " << s << " s  (control returned"
+                  << (trashed.empty() ? ", rename failed" : "") << ")" << std::endl;
+        if (!trashed.empty()) Trash::spawnReaper(trashed);
+    }
+    return 0;
+}
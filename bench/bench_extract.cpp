@@ -0,0 +1,165 @@
+// Extraction and integrity-check throughput against a real setup file produced by pack.py.
+#include "bench.h"
+#include "core/Extractor.h"
+#include "core/Verifier.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+bool openSetup(const std::vector<std::string>& args, PayloadReader& payload) {
+    std::string setup = benchOption(args, "--setup", "");
+    if (setup.empty() || !payload.open(setup)) {
+        std::cerr << "need --setup <file packed by pack.py>" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int benchExtract(const std::vector<std::string>& args) {
+    PayloadReader payload;
+    if (!openSetup(args, payload)) return 2;
+
+    // Scaling across block runs; the largest run bounds what extra threads can gain
+    std::vector<BlockRun> runs = splitBlockRuns(payload.blocks());
+    uint64_t total = 0, largest = 0;
+    for (const auto& r : runs) {
+        total += r.rawSize;
+        largest = std::max(largest, r.rawSize);
+    }
+    std::cout << "extract: " << runs.size() << " block runs, largest "
+              << (total ? 100.0 * largest / total : 100.0) << "% of the archive" << std::endl;
+    double base = 0;
+    bool ok = true;
+    auto once = [&](unsigned threads, bool pipeline) {
+        fs::path out = benchScratchDir(args, "miko_bench_extract");
+        ExtractOptions opts;
+        opts.threads = threads;
+        opts.pipeline = pipeline;
+        Extractor extractor(payload, out);
+        uint64_t allocsBefore = benchAllocations();
+        BenchTimer t;
+        bool runOk = extractor.run(opts);
+        double s = t.seconds();
+        uint64_t allocs = benchAllocations() - allocsBefore;
+        if (!base) base = s; // speedups are against the first row
+        double mib = extractor.bytesWritten() / (1024.0 * 1024.0);
+        // Labelled by what ran: mostly stored payloads decode inline even when asked to pipeline
+        std::string mode = extractor.pipelined() ? ", pipelined" : threads == 1 ? ", inline" : "";
+        if (pipeline && threads == 1 && !extractor.pipelined()) mode += " (pipeline declined: mostly stored)";
+        std::cout << "  " << threads << " threads" << mode
+                  << "  " << extractor.filesWritten() << " files, " << mib << " MiB in "
+                  << s << " s  " << mib / s << " MiB/s  " << extractor.filesWritten() / s << " files/s  "
+                  << "speedup " << base / s << "x  " << extractor.runsStolen() << " runs stolen  "
+                  << allocs << " allocations (" << (double)allocs / std::max<uint64_t>(1, extractor.filesWritten())
+                  << " per file)" << (runOk ? "" : "  FAILED: " + extractor.error()) << std::endl;
+        const ExtractIoStats& io = extractor.ioStats();
+        double perFile = 1.0 / std::max<uint64_t>(1, extractor.filesWritten());
+        std::cout << "    fs ops: " << io.total() * perFile << " per file (" << io.mkdirs << " mkdir, "
+                  << io.dirOpens << " dir open, " << io.fileOpens << " open, " << io.writes << " write, "
+                  << io.closes << " close, " << io.renames << " rename)" << std::endl;
+        const RingStats& ring = extractor.pipelineStats();
+        if (ring.slotsPassed) {
+            std::cout << "    ring: " << ring.slotsPassed << " slots, occupancy mean " << ring.meanOccupancy
+                      << " peak " << ring.peakOccupancy << ", decoder waited " << ring.producerWaits
+                      << "x, parser waited " << ring.consumerWaits << "x, " << ring.parks << " parks" << std::endl;
+        }
+        ok = ok && runOk;
+        std::error_code ec;
+        fs::remove_all(out, ec);
+    };
+    for (unsigned threads : benchThreadList(args, "1,2,4,8,16")) {
+        // One worker both ways: decode inline, and decode on its own thread through the ring
+        if (threads == 1) once(1, false);
+        once(threads, true);
+    }
+
+    // Buffer pool sizes: larger buffers mean fewer, larger reads and writes, at the cost of
+    // memory held per lane (a read, a decode and a write buffer each)
+    std::vector<uint64_t> poolKib;
+    std::stringstream ss(benchOption(args, "--pool-kib", "64,256,1024,4096"));
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (uint64_t kib = std::strtoull(item.c_str(), nullptr, 10)) poolKib.push_back(kib);
+    }
+    unsigned poolThreads = (unsigned)benchOptionU64(args, "--pool-threads", 1);
+    bool huge = benchFlag(args, "--huge-pages");
+    std::cout << "buffer pool, " << poolThreads << " threads" << (huge ? ", huge pages" : "") << std::endl;
+    for (uint64_t kib : poolKib) {
+        fs::path out = benchScratchDir(args, "miko_bench_extract");
+        BufferPool pool((size_t)kib * 1024, 0, huge);
+        ExtractOptions opts;
+        opts.threads = poolThreads;
+        opts.buffers = &pool;
+        Extractor extractor(payload, out);
+        benchResetPeakMemory();
+        BenchTimer t;
+        bool runOk = extractor.run(opts);
+        double s = t.seconds();
+        double mib = extractor.bytesWritten() / (1024.0 * 1024.0);
+        std::cout << "  " << kib << " KiB buffers  " << mib / s << " MiB/s written  "
+                  << extractor.ioStats().writes << " writes  " << pool.peakInUse() << " buffers in use at peak, "
+                  << pool.bytesReserved() / (1024.0 * 1024.0) << " MiB reserved"
+                  << (pool.hugePageBuffers() ? " (" + std::to_string(pool.hugePageBuffers()) + " on huge pages)" : "")
+                  << "  peak RSS " << benchPeakMemory() / (1024.0 * 1024.0) << " MiB"
+                  << (runOk ? "" : "  FAILED: " + extractor.error()) << std::endl;
+        ok = ok && runOk;
+        std::error_code ec;
+        fs::remove_all(out, ec);
+    }
+
+    return ok ? 0 : 1;
+}
+
+int benchVerify(const std::vector<std::string>& args) {
+    PayloadReader payload;
+    if (!openSetup(args, payload)) return 2;
+    std::vector<PayloadFileHash> expected = payload.fileHashes();
+    fs::path out = benchScratchDir(args, "miko_bench_verify");
+    Extractor extractor(payload, out);
+    if (!extractor.run()) {
+        std::cerr << "extract failed: " << extractor.error() << std::endl;
+        return 1;
+    }
+
+    std::cout << "verify: " << expected.size() << " files" << std::endl;
+    for (unsigned threads : benchThreadList(args, "1,2,4,8")) {
+        Verifier verifier(threads);
+        VerifyReport r = verifier.verify(out, expected);
+        std::cout << "  " << threads << " threads  " << r.seconds << " s  "
+                  << r.bytesHashed / (1024.0 * 1024.0) / r.seconds << " MiB/s"
+                  << (r.clean() ? "" : "  (issues!)") << std::endl;
+    }
+
+    // Damage a few files, then time repair, which decodes once and rewrites only those
+    size_t damaged = 0;
+    for (size_t i = 0; i < expected.size() && damaged < 3; i += std::max<size_t>(1, expected.size() / 3)) {
+        fs::path p = manifestPath(out, expected[i].path);
+        if (damaged == 0) {
+            std::error_code ec;
+            fs::remove(p, ec);
+        } else {
+            std::ofstream(p, std::ios::binary | std::ios::in | std::ios::out).write("\xde\xad", 2);
+        }
+        ++damaged;
+    }
+    Verifier verifier;
+    VerifyReport before = verifier.verify(out, expected);
+    BenchTimer t;
+    std::string error;
+    bool ok = verifier.repair(payload, out, before, &error);
+    double s = t.seconds();
+    VerifyReport after = verifier.verify(out, expected);
+    std::cout << "  repair of " << before.issues.size() << " files  " << s << " s  "
+              << (ok && after.clean() ? "intact afterwards" : "FAILED: " + error) << std::endl;
+    std::error_code ec;
+    fs::remove_all(out, ec);
+    return ok && after.clean() ? 0 : 1;
+}
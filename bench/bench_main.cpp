@@ -0,0 +1,131 @@
+// Headless benchmarks for the install/uninstall engine.
+// Built with -DMIKO_BUILD_BENCHMARKS=ON; run as: miko_bench <suite> [options]
+#include "bench.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+
+namespace {
+
+std::atomic<uint64_t> allocations{0};
+
+} // namespace
+
+// Counting replacements for the global allocation functions. The nothrow forms forward
+// to these; over-aligned allocations are rare here and not counted.
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    std::free(p);
+}
+
+uint64_t benchAllocations() {
+    return allocations.load();
+}
+
+std::string benchOption(const std::vector<std::string>& args, const std::string& name, const std::string& fallback) {
+    for (size_t i = 0; i + 1 < args.size(); ++i) {
+        if (args[i] == name) return args[i + 1];
+    }
+    return fallback;
+}
+
+uint64_t benchOptionU64(const std::vector<std::string>& args, const std::string& name, uint64_t fallback) {
+    std::string v = benchOption(args, name, "");
+    return v.empty() ? fallback : std::strtoull(v.c_str(), nullptr, 10);
+}
+
+bool benchFlag(const std::vector<std::string>& args, const std::string& name) {
+    for (const auto& a : args) {
+        if (a == name) return true;
+    }
+    return false;
+}
+
+std::vector<unsigned> benchThreadList(const std::vector<std::string>& args, const std::string& fallback) {
+    std::vector<unsigned> out;
+    std::stringstream ss(benchOption(args, "--threads", fallback));
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        unsigned n = (unsigned)std::strtoul(item.c_str(), nullptr, 10);
+        if (n) out.push_back(n);
+    }
+    return out;
+}
+
+uint64_t benchPeakMemory() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+    }
+    return 0;
+}
+
+void benchResetPeakMemory() {
+    // "5" resets VmHWM to the current resident size (Linux 4.0+)
+    std::ofstream("/proc/self/clear_refs") << "5";
+}
+
+std::filesystem::path benchScratchDir(const std::vector<std::string>& args, const std::string& name) {
+    std::string base = benchOption(args, "--dir", "");
+    std::filesystem::path dir = (base.empty() ? std::filesystem::temp_directory_path() : std::filesystem::path(base)) / name;
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+    std::filesystem::create_directories(dir, ec);
+    return dir;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: miko_bench <suite> [options]\n"
+                  << "  delete   --files N --threads 1,2,4,8 [--dir D]   manifest-driven parallel uninstall\n"
+                  << "  swap     --files 1000,10000,100000 [--dir D]      staged install commit/rollback\n"
+                  << "  extract  --setup S --threads 1,2,4,8,16 [--dir D]  parallel payload extraction scaling\n"
+                  << "           [--pool-kib 64,256,1024,4096] [--pool-threads N] [--huge-pages]  I/O buffer pool sizes\n"
+                  << "  verify   --setup S --threads 1,2,4,8 [--dir D]     parallel verify, then repair\n"
+                  << "  write    --files 50000 --threads 1,4 [--backends direct,threads,io_uring] [--depth 64]\n"
+                  << "                                                     small-file write backends\n"
+                  << "  large    --sizes-mib 1,16,256,2048 [--buffer-kib 1024] [--dir D]  large-file write strategies\n"
+                  << "  durability [--setup S | --files 5000] [--threads 4] [--dir D]  cost of each durability mode\n"
+                  << "  stored   [--setup S | --files 64 --size-kib 4096 [--page-align]] --threads 1,4\n"
+                  << "                                                     stored entries read, mapped or copied\n";
+        return 2;
+    }
+    std::string suite = argv[1];
+    std::vector<std::string> args(argv + 2, argv + argc);
+    if (suite == "delete") return benchDelete(args);
+    if (suite == "swap") return benchSwap(args);
+    if (suite == "extract") return benchExtract(args);
+    if (suite == "verify") return benchVerify(args);
+    if (suite == "write") return benchWrite(args);
+    if (suite == "large") return benchLargeFiles(args);
+    if (suite == "durability") return benchDurability(args);
+    if (suite == "stored") return benchStored(args);
+    std::cerr << "unknown suite: " << suite << std::endl;
+    return 2;
+}
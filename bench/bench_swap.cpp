@@ -0,0 +1,63 @@
+// Cost of the transactional install's commit and rollback: both are renames, so the time
+// should stay flat while the staged tree grows.
+#include "bench.h"
+#include "core/InstallManifest.h"
+#include "core/StagedInstall.h"
+#include "core/Trash.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+void fillTree(const fs::path& root, uint64_t fileCount) {
+    for (uint64_t i = 0; i < fileCount; ++i) {
+        char rel[64];
+        snprintf(rel, sizeof(rel), "d%03u/e%02u/f%06llu.dat", (unsigned)(i % 200), (unsigned)((i / 200) % 16),
+                 (unsigned long long)i);
+        fs::path p = root / rel;
+        std::error_code ec;
+        fs::create_directories(p.parent_path(), ec);
+        std::ofstream(p, std::ios::binary) << i;
+    }
+}
+
+} // namespace
+
+int benchSwap(const std::vector<std::string>& args) {
+    std::vector<uint64_t> sizes;
+    std::stringstream ss(benchOption(args, "--files", "1000,10000,100000"));
+    std::string item;
+    while (std::getline(ss, item, ',')) sizes.push_back(std::strtoull(item.c_str(), nullptr, 10));
+
+    std::cout << "swap: commit over an existing install, and rollback" << std::endl;
+    for (uint64_t files : sizes) {
+        fs::path base = benchScratchDir(args, "miko_bench_swap");
+        fs::path target = base / "MikoIDE";
+        fillTree(target, files);
+        // Only an install with a manifest is replaced
+        InstallManifest::scan(target).save(target / MIKO_MANIFEST_FILE);
+
+        StagedInstall stage(target);
+        stage.begin();
+        fillTree(stage.stagingPath(), files);
+        bool ok = stage.commit();
+        double commitMs = stage.lastSwapSeconds() * 1000.0;
+
+        stage.begin();
+        fillTree(stage.stagingPath(), files);
+        BenchTimer t;
+        stage.rollback();
+        double rollbackMs = t.seconds() * 1000.0;
+
+        std::cout << "  " << files << " files  commit " << commitMs << " ms  rollback " << rollbackMs << " ms"
+                  << (ok ? "" : "  (commit failed)") << std::endl;
+        std::error_code ec;
+        fs::remove_all(target, ec);
+    }
+    return 0;
+}
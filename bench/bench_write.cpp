@@ -0,0 +1,421 @@
+// Write-path benchmarks: small-file throughput of the extraction write backends over a
+// synthetic payload of many small files (stored blocks, so decoding costs nothing and the
+// writes dominate), and the large-file write strategies of OutputFile.
+#include "bench.h"
+#include "core/Extractor.h"
+#include "core/OutputFile.h"
+#include "core/StagedInstall.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const uint64_t BLOCK_TARGET = 1 << 20;
+
+void putLE(std::string& out, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; ++i) out.push_back((char)(v >> (8 * i)));
+}
+
+void tarHeader(std::string& out, const std::string& path, uint64_t size, char type) {
+    char h[512] = {};
+    memcpy(h, path.data(), std::min<size_t>(path.size(), 99));
+    snprintf(h + 100, 8, "%07o", type == '5' ? 0755 : 0644);
+    snprintf(h + 108, 8, "%07o", 0);
+    snprintf(h + 116, 8, "%07o", 0);
+    snprintf(h + 124, 12, "%011llo", (unsigned long long)size);
+    snprintf(h + 136, 12, "%011o", 0);
+    h[156] = type;
+    memcpy(h + 257, "ustar\0" "00", 8);
+    memset(h + 148, ' ', 8);
+    unsigned sum = 0;
+    for (unsigned char c : h) sum += c;
+    snprintf(h + 148, 8, "%06o", sum);
+    out.append(h, sizeof(h));
+}
+
+// Appends one BIDX entry for a stored block that starts an entry
+void putStoredBlock(std::string& index, uint64_t offset, uint64_t size, uint32_t flags = MIKO_BLOCK_ENTRY_START) {
+    putLE(index, offset, 8);
+    putLE(index, size, 8);
+    putLE(index, size, 8);
+    index.append(MIKO_CODEC_STORE, 4);
+    putLE(index, flags, 4);
+}
+
+void cutStoredBlock(std::string& index, uint64_t& blockCount, uint64_t& blockStart, uint64_t end) {
+    if (end == blockStart) return;
+    putStoredBlock(index, blockStart, end - blockStart);
+    ++blockCount;
+    blockStart = end;
+}
+
+// Writes `blob` as a "BLKS" payload with the given BIDX entries and a PLAN section;
+// `archiveBytes` is the TAR size, which padding between blocks can make smaller than the blob
+bool writeBlockPayload(const fs::path& file, const std::string& blob, uint64_t archiveBytes, const std::string& blocks,
+                       uint64_t blockCount, const std::vector<std::string>& dirs, uint64_t files, uint64_t totalBytes,
+                       uint64_t largest) {
+    std::string plan;
+    putLE(plan, files, 8);
+    putLE(plan, totalBytes, 8);
+    putLE(plan, largest, 8);
+    putLE(plan, archiveBytes, 8);
+    putLE(plan, dirs.size(), 8);
+    for (const auto& d : dirs) {
+        putLE(plan, d.size(), 2);
+        plan.append(d);
+    }
+    std::string index;
+    putLE(index, blockCount, 8);
+    index.append(blocks);
+
+    std::string sections;
+    for (const auto& s : {std::make_pair(MIKO_SECTION_BLOCKS, &index), std::make_pair(MIKO_SECTION_PLAN, &plan)}) {
+        sections.append(s.first, 4);
+        putLE(sections, 0, 4);
+        putLE(sections, s.second->size(), 8);
+        sections.append(*s.second);
+    }
+    std::string trailer;
+    putLE(trailer, blob.size(), 8);
+    putLE(trailer, sections.size(), 8);
+    putLE(trailer, 0, 8);
+    putLE(trailer, 0, 8);
+    std::ofstream out(file, std::ios::binary);
+    out.write(MIKO_MAGIC, MIKO_MAGIC_LEN);
+    out.write(MIKO_ALGO_BLOCKS, 4);
+    out << blob << sections << trailer;
+    return (bool)out;
+}
+
+// A "BLKS" payload of `files` small files over a few hundred directories, each block
+// starting on an entry so the extractor can also run it in parallel
+bool writeSmallFilePayload(const fs::path& file, uint64_t files, uint64_t& totalBytes) {
+    const unsigned dirCount = 400;
+    std::string tar, blocks;
+    std::vector<std::string> dirs;
+    uint64_t blockCount = 0, blockStart = 0, largest = 0;
+    totalBytes = 0;
+    for (unsigned d = 0; d < dirCount; ++d) {
+        char name[32];
+        if (d % 20 == 0) {
+            snprintf(name, sizeof(name), "pkg%02u", d / 20);
+            dirs.push_back(name);
+            tarHeader(tar, name, 0, '5');
+        }
+        snprintf(name, sizeof(name), "pkg%02u/mod%03u", d / 20, d);
+        dirs.push_back(name);
+        tarHeader(tar, name, 0, '5');
+    }
+    std::string content;
+    for (uint64_t i = 0; i < files; ++i) {
+        // 100 B to 16 KiB, mostly at the small end, like an IDE's resources and sources
+        uint64_t size = 100 + (i * 2654435761u) % (i % 4 ? 4096 : 16384);
+        char path[64];
+        unsigned d = (unsigned)(i * dirCount / files);
+        snprintf(path, sizeof(path), "pkg%02u/mod%03u/f%06llu.txt", d / 20, d, (unsigned long long)i);
+        content.assign((size_t)size, (char)('a' + i % 26));
+        tarHeader(tar, path, size, '0');
+        tar.append(content);
+        tar.append((512 - size % 512) % 512, '\0');
+        totalBytes += size;
+        largest = std::max(largest, size);
+        if (tar.size() - blockStart >= BLOCK_TARGET) cutStoredBlock(blocks, blockCount, blockStart, tar.size());
+    }
+    tar.append(1024, '\0');
+    cutStoredBlock(blocks, blockCount, blockStart, tar.size());
+    return writeBlockPayload(file, tar, tar.size(), blocks, blockCount, dirs, files, totalBytes, largest);
+}
+
+// A "BLKS" payload of `files` incompressible files of `size` bytes, each in a stored
+// block of its own as pack.py lays out already-compressed media and archives; with
+// `pageAlign` padded like pack.py --page-align, so every file's data is page aligned
+bool writeStoredPayload(const fs::path& file, uint64_t files, uint64_t size, bool pageAlign, uint64_t& totalBytes) {
+    std::string blob, blocks, entry;
+    uint64_t archiveBytes = 0, state = 0x9E3779B97F4A7C15ull;
+    tarHeader(entry, "media", 0, '5');
+    putStoredBlock(blocks, 0, entry.size());
+    blob += entry;
+    archiveBytes += entry.size();
+    std::string content((size_t)size, '\0');
+    for (uint64_t i = 0; i < files; ++i) {
+        for (size_t k = 0; k + 8 <= content.size(); k += 8) {
+            state ^= state << 13; state ^= state >> 7; state ^= state << 17; // xorshift64
+            memcpy(&content[k], &state, 8);
+        }
+        char path[64];
+        snprintf(path, sizeof(path), "media/clip%04llu.mp4", (unsigned long long)i);
+        entry.clear();
+        tarHeader(entry, path, size, '0');
+        entry.append(content);
+        entry.append((512 - size % 512) % 512, '\0');
+        if (i + 1 == files) entry.append(1024, '\0');
+        uint32_t flags = MIKO_BLOCK_ENTRY_START;
+        if (pageAlign) {
+            // The blob starts right after the magic and algorithm; the data after the header
+            uint64_t dataAt = MIKO_MAGIC_LEN + MIKO_ALGO_LEN + blob.size() + 512;
+            blob.append((size_t)((MIKO_PAGE_ALIGN - dataAt % MIKO_PAGE_ALIGN) % MIKO_PAGE_ALIGN), '\0');
+            flags |= MIKO_BLOCK_ENTRY_ALIGNED;
+        }
+        putStoredBlock(blocks, blob.size(), entry.size(), flags);
+        blob += entry;
+        archiveBytes += entry.size();
+    }
+    totalBytes = files * size;
+    return writeBlockPayload(file, blob, archiveBytes, blocks, files + 1, {"media"}, files, totalBytes, size);
+}
+
+// Extents the file occupies on disk, 0 when the filesystem cannot say
+uint64_t countExtents(const fs::path& file) {
+#ifdef __linux__
+    int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    struct fiemap map;
+    memset(&map, 0, sizeof(map));
+    map.fm_length = FIEMAP_MAX_OFFSET;
+    map.fm_flags = FIEMAP_FLAG_SYNC;
+    uint64_t extents = ioctl(fd, FS_IOC_FIEMAP, &map) == 0 ? map.fm_mapped_extents : 0;
+    ::close(fd);
+    return extents;
+#else
+    (void)file;
+    return 0;
+#endif
+}
+
+// Seconds to get a written file's data to disk
+double syncSeconds(const fs::path& file) {
+#ifdef __linux__
+    BenchTimer t;
+    int fd = ::open(file.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    ::fsync(fd);
+    ::close(fd);
+    return t.seconds();
+#else
+    (void)file;
+    return 0;
+#endif
+}
+
+} // namespace
+
+int benchWrite(const std::vector<std::string>& args) {
+    uint64_t files = benchOptionU64(args, "--files", 50000);
+    size_t depth = (size_t)benchOptionU64(args, "--depth", 64);
+    fs::path payloadDir = benchScratchDir(args, "miko_bench_write_payload");
+    fs::path setup = payloadDir / "small.setup";
+    uint64_t totalBytes = 0;
+    PayloadReader payload;
+    if (!writeSmallFilePayload(setup, files, totalBytes) || !payload.open(setup)) {
+        std::cerr << "cannot build the synthetic payload" << std::endl;
+        return 1;
+    }
+
+    std::vector<WriteBackendKind> kinds;
+    std::stringstream ss(benchOption(args, "--backends", "direct,threads,io_uring"));
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        for (auto k : {WriteBackendKind::Direct, WriteBackendKind::IoUring, WriteBackendKind::Threads,
+                       WriteBackendKind::Auto}) {
+            if (item == writeBackendName(k)) kinds.push_back(k);
+        }
+    }
+
+    std::cout << "write: " << files << " files, " << totalBytes / (1024.0 * 1024.0) << " MiB, batches of "
+              << depth << std::endl;
+    bool ok = true;
+    for (unsigned threads : benchThreadList(args, "1,4")) {
+        for (WriteBackendKind kind : kinds) {
+            fs::path out = benchScratchDir(args, "miko_bench_write");
+            ExtractOptions opts;
+            opts.threads = threads;
+            opts.pipeline = false;
+            opts.writer = kind;
+            opts.writeDepth = depth;
+            opts.copyStored = false; // the payload is stored only to keep decoding out of the way
+            Extractor extractor(payload, out);
+            BenchTimer t;
+            bool runOk = extractor.run(opts) && extractor.filesWritten() == files;
+            double s = t.seconds();
+            const ExtractIoStats& io = extractor.ioStats();
+            std::cout << "  " << threads << " threads  " << writeBackendName(kind) << "  " << s << " s  "
+                      << (uint64_t)(extractor.filesWritten() / s) << " files/s  "
+                      << extractor.bytesWritten() / (1024.0 * 1024.0) / s << " MiB/s  "
+                      << (double)io.total() / std::max<uint64_t>(1, extractor.filesWritten()) << " fs ops per file, "
+                      << io.submits << " ring submits" << (runOk ? "" : "  FAILED: " + extractor.error())
+                      << std::endl;
+            ok = ok && runOk;
+            std::error_code ec;
+            fs::remove_all(out, ec);
+        }
+    }
+    std::error_code ec;
+    fs::remove_all(payloadDir, ec);
+    return ok ? 0 : 1;
+}
+
+int benchLargeFiles(const std::vector<std::string>& args) {
+    std::vector<uint64_t> sizesMib;
+    std::stringstream ss(benchOption(args, "--sizes-mib", "1,16,256,2048"));
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (uint64_t mib = std::strtoull(item.c_str(), nullptr, 10)) sizesMib.push_back(mib);
+    }
+    BufferPool pool((size_t)benchOptionU64(args, "--buffer-kib", 1024) * 1024);
+    BufferPool::Buffer buffer = pool.acquire();
+    // Fed in decoder-sized slices of incompressible-looking data
+    std::vector<uint8_t> slice(256 * 1024);
+    uint32_t x = 2463534242u;
+    for (auto& b : slice) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        b = (uint8_t)x;
+    }
+    struct Strategy {
+        const char* name;
+        OutputFile::Mode mode;
+        bool preallocate;
+    };
+    const Strategy strategies[] = {
+        {"grow", OutputFile::Mode::Buffered, false},
+        {"preallocated", OutputFile::Mode::Buffered, true},
+        {"aligned", OutputFile::Mode::Aligned, true},
+        {"unbuffered", OutputFile::Mode::Unbuffered, true},
+    };
+
+    std::cout << "large files: " << buffer.size() / 1024 << " KiB buffer" << std::endl;
+    bool ok = true;
+    for (uint64_t mib : sizesMib) {
+        for (const Strategy& st : strategies) {
+            fs::path dir = benchScratchDir(args, "miko_bench_large");
+            fs::path file = dir / "runtime.bin";
+            ExtractIoStats io;
+            OutputFile out(io);
+            out.setBuffer(buffer.data(), buffer.size());
+            uint64_t size = mib << 20;
+            BenchTimer t;
+            bool runOk = out.open(-1, nullptr, file.u8string().c_str(), st.mode);
+            if (runOk && st.preallocate) out.preallocate(size);
+            for (uint64_t done = 0; runOk && done < size; done += slice.size()) {
+                runOk = out.write(slice.data(), (size_t)std::min<uint64_t>(slice.size(), size - done));
+            }
+            runOk = out.close() && runOk;
+            double s = t.seconds();
+            double sync = syncSeconds(file);
+            std::error_code ec;
+            runOk = runOk && fs::file_size(file, ec) == size;
+            std::cout << "  " << mib << " MiB  " << st.name << "  " << mib / s << " MiB/s written, "
+                      << mib / (s + sync) << " MiB/s to disk  " << io.writes << " writes  "
+                      << countExtents(file) << " extents" << (runOk ? "" : "  FAILED") << std::endl;
+            ok = ok && runOk;
+            fs::remove_all(dir, ec);
+        }
+    }
+    return ok ? 0 : 1;
+}
+
+int benchDurability(const std::vector<std::string>& args) {
+    uint64_t files = benchOptionU64(args, "--files", 5000);
+    fs::path payloadDir = benchScratchDir(args, "miko_bench_durability_payload");
+    std::string setupOption = benchOption(args, "--setup", "");
+    fs::path setup = setupOption.empty() ? payloadDir / "small.setup" : fs::path(setupOption);
+    uint64_t totalBytes = 0;
+    PayloadReader payload;
+    if ((setupOption.empty() && !writeSmallFilePayload(setup, files, totalBytes)) || !payload.open(setup)) {
+        std::cerr << "cannot open payload: " << setup << std::endl;
+        return 1;
+    }
+    unsigned threads = (unsigned)benchOptionU64(args, "--threads", 4);
+
+    std::cout << "durability: " << setup.filename().string() << ", " << threads << " threads" << std::endl;
+    bool ok = true;
+    for (Durability mode : {Durability::None, Durability::SyncAtEnd, Durability::DirectoryBarriers,
+                            Durability::PerFile}) {
+        fs::path target = benchScratchDir(args, "miko_bench_durability") / "app";
+        StagedInstall stage{target, mode};
+        ExtractOptions opts;
+        opts.threads = threads;
+        opts.durability = mode;
+        BenchTimer t;
+        bool runOk = stage.begin();
+        Extractor extractor(payload, stage.stagingPath());
+        runOk = runOk && extractor.run(opts);
+        double extractSeconds = t.seconds();
+        runOk = runOk && stage.commit();
+        double s = t.seconds();
+        std::cout << "  " << durabilityName(mode) << "  " << s << " s  (extract " << extractSeconds
+                  << " s, commit " << stage.lastSwapSeconds() * 1000.0 << " ms + barriers "
+                  << stage.lastBarrierSeconds() * 1000.0 << " ms)  " << (uint64_t)(extractor.filesWritten() / s)
+                  << " files/s  " << extractor.ioStats().syncs << " syncs"
+                  << (runOk ? "" : "  FAILED: " + extractor.error()) << std::endl;
+        if (!runOk) stage.rollback();
+        ok = ok && runOk;
+        std::error_code ec;
+        fs::remove_all(target.parent_path(), ec);
+    }
+    std::error_code ec;
+    fs::remove_all(payloadDir, ec);
+    return ok ? 0 : 1;
+}
+
+int benchStored(const std::vector<std::string>& args) {
+    uint64_t files = benchOptionU64(args, "--files", 64);
+    uint64_t size = benchOptionU64(args, "--size-kib", 4096) * 1024;
+    fs::path payloadDir = benchScratchDir(args, "miko_bench_stored_payload");
+    std::string setupOption = benchOption(args, "--setup", "");
+    fs::path setup = setupOption.empty() ? payloadDir / "stored.setup" : fs::path(setupOption);
+    uint64_t totalBytes = 0;
+    PayloadReader payload;
+    bool pageAlign = benchFlag(args, "--page-align");
+    if ((setupOption.empty() && !writeStoredPayload(setup, files, size, pageAlign, totalBytes)) ||
+        !payload.open(setup)) {
+        std::cerr << "cannot open payload: " << setup << std::endl;
+        return 1;
+    }
+
+    std::cout << "stored: " << setup.filename().string() << ", " << payload.blobSize() / (1024.0 * 1024.0)
+              << " MiB blob" << std::endl;
+    bool ok = true;
+    // read: through a buffer (mapped in place when aligned); unbuffered: read, but written
+    // with O_DIRECT, straight from the mapping when aligned; copy: file to file
+    const char* modes[] = {"read", "unbuffered", "copy"};
+    for (unsigned threads : benchThreadList(args, "1,4")) {
+        for (const char* mode : modes) {
+            fs::path out = benchScratchDir(args, "miko_bench_stored");
+            ExtractOptions opts;
+            opts.threads = threads;
+            opts.copyStored = mode == modes[2];
+            opts.unbufferedLargeFiles = mode == modes[1];
+            opts.largeFileThreshold = 1 << 20;
+            Extractor extractor(payload, out);
+            benchResetPeakMemory();
+            BenchTimer t;
+            bool runOk = extractor.run(opts);
+            double s = t.seconds();
+            const ExtractIoStats& io = extractor.ioStats();
+            std::cout << "  " << threads << " threads  " << mode << "  " << s << " s  "
+                      << extractor.bytesWritten() / (1024.0 * 1024.0) / s << " MiB/s  "
+                      << io.copiedBytes / (1024.0 * 1024.0) << " MiB copied in " << io.copies << " calls, "
+                      << io.writes << " writes, peak RSS " << benchPeakMemory() / (1024 * 1024) << " MiB"
+                      << (runOk ? "" : "  FAILED: " + extractor.error()) << std::endl;
+            ok = ok && runOk;
+            std::error_code ec;
+            fs::remove_all(out, ec);
+        }
+    }
+    std::error_code ec;
+    fs::remove_all(payloadDir, ec);
+    return ok ? 0 : 1;
+}
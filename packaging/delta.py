@@ -0,0 +1,258 @@
+# Patch payload support for pack.py: reads a previous MIKOSETUP payload, decides which
+# files changed, and encodes modified large files as COPY/ADD deltas against the old copy.
+#
+# Files are cut into content-defined chunks (Gear rolling hash), so an insertion only
+# disturbs the chunks around it; every chunk of the new file that also occurs in the old
+# file becomes a COPY of the old bytes, everything else is carried literally as ADD.
+# The delta stream format is documented in src/interface/installer/format.h.
+
+import hashlib
+import io
+import lzma
+import os
+import random
+import struct
+import tarfile
+
+from payload_format import (
+    HASH_ENTRY, MAGIC, SECTION_HEADER, TRAILER_STRUCT, decompress_block, parse_blocks,
+    parse_sections)
+
+DELTA_MAGIC = b"MIKODLT1"
+DELTA_HEADER = struct.Struct("<8s Q Q")  # (magic, base_size, target_size)
+DELTA_COPY = struct.Struct("<B Q Q")  # (1, base_offset, length)
+DELTA_ADD = struct.Struct("<B Q")  # (2, length) followed by the bytes
+OP_COPY = 1
+OP_ADD = 2
+DELTA_PREFIX = ".miko-delta/"
+
+CHUNK_MIN = 2 * 1024
+CHUNK_MAX = 64 * 1024
+CHUNK_MASK = 0xFFF80000  # 13 bits: about 8 KiB past the minimum on average
+
+_rng = random.Random(0x4D494B4F)
+GEAR = [_rng.getrandbits(32) for _ in range(256)]
+
+
+def chunks(data: bytes):
+    """Yields (offset, length) of content-defined chunks covering data."""
+    gear = GEAR
+    n = len(data)
+    start = 0
+    while start < n:
+        end = min(start + CHUNK_MAX, n)
+        # The hash only sees the last 32 bytes, so the minimum can be skipped outright
+        i = min(start + CHUNK_MIN, end)
+        h = 0
+        for b in data[max(start, i - 32):i]:
+            h = ((h << 1) + gear[b]) & 0xFFFFFFFF
+        while i < end:
+            h = ((h << 1) + gear[data[i]]) & 0xFFFFFFFF
+            i += 1
+            if not h & CHUNK_MASK:
+                break
+        yield start, i - start
+        start = i
+
+
+def chunk_digest(view) -> bytes:
+    return hashlib.blake2b(view, digest_size=16).digest()
+
+
+def make_delta(base_path: str, target_path: str) -> bytes:
+    """Encodes target as COPY/ADD operations against base."""
+    with open(base_path, "rb") as f:
+        base = f.read()
+    with open(target_path, "rb") as f:
+        target = f.read()
+    index = {}
+    bview = memoryview(base)
+    for off, length in chunks(base):
+        index.setdefault(chunk_digest(bview[off:off + length]), (off, length))
+
+    out = [DELTA_HEADER.pack(DELTA_MAGIC, len(base), len(target))]
+    tview = memoryview(target)
+    copy_off = copy_len = 0
+    add_start = None  # start of the pending literal run; chunks are contiguous
+
+    for off, length in chunks(target):
+        hit = index.get(chunk_digest(tview[off:off + length]))
+        if hit is not None and hit[1] == length:
+            if add_start is not None:
+                out.append(DELTA_ADD.pack(OP_ADD, off - add_start))
+                out.append(bytes(tview[add_start:off]))
+                add_start = None
+            if copy_len and copy_off + copy_len == hit[0]:
+                copy_len += length  # continues the previous copy
+            else:
+                if copy_len:
+                    out.append(DELTA_COPY.pack(OP_COPY, copy_off, copy_len))
+                copy_off, copy_len = hit
+        else:
+            if copy_len:
+                out.append(DELTA_COPY.pack(OP_COPY, copy_off, copy_len))
+                copy_len = 0
+            if add_start is None:
+                add_start = off
+    if copy_len:
+        out.append(DELTA_COPY.pack(OP_COPY, copy_off, copy_len))
+    if add_start is not None:
+        out.append(DELTA_ADD.pack(OP_ADD, len(target) - add_start))
+        out.append(bytes(tview[add_start:]))
+    return b"".join(out)
+
+
+def make_checked_delta(base_path: str, target_path: str, target_sha: bytes):
+    """Returns the delta, or None when it fails to round-trip or saves too little to matter."""
+    delta = make_delta(base_path, target_path)
+    size = os.path.getsize(target_path)
+    if len(delta) > size * 0.9:
+        return None
+    with open(base_path, "rb") as f:
+        rebuilt = apply_delta(f.read(), delta)
+    if hashlib.sha256(rebuilt).digest() != target_sha:
+        return None
+    return delta
+
+
+def apply_delta(base: bytes, delta: bytes) -> bytes:
+    """Reference decoder, used to self-check every delta before it is shipped."""
+    magic, base_size, target_size = DELTA_HEADER.unpack_from(delta, 0)
+    if magic != DELTA_MAGIC or base_size != len(base):
+        raise ValueError("delta does not match its base")
+    out = bytearray()
+    p = DELTA_HEADER.size
+    while p < len(delta):
+        op = delta[p]
+        if op == OP_COPY:
+            _, off, length = DELTA_COPY.unpack_from(delta, p)
+            out += base[off:off + length]
+            p += DELTA_COPY.size
+        elif op == OP_ADD:
+            _, length = DELTA_ADD.unpack_from(delta, p)
+            p += DELTA_ADD.size
+            out += delta[p:p + length]
+            p += length
+        else:
+            raise ValueError("bad delta op")
+    if len(out) != target_size:
+        raise ValueError("delta produced the wrong size")
+    return bytes(out)
+
+
+class _BlobReader(io.RawIOBase):
+    """Read-only window over the blob of a setup file."""
+
+    def __init__(self, f, offset: int, size: int):
+        self.f = f
+        self.f.seek(offset)
+        self.left = size
+
+    def readable(self):
+        return True
+
+    def readinto(self, b):
+        n = min(len(b), self.left)
+        data = self.f.read(n)
+        b[:len(data)] = data
+        self.left -= len(data)
+        return len(data)
+
+
+class _BlockReader(io.RawIOBase):
+    """Decoded TAR stream of a "BLKS" blob, one block in memory at a time."""
+
+    def __init__(self, f, blob_offset: int, blocks, zdict: bytes = None):
+        self.f = f
+        self.zdict = zdict
+        self.blob_offset = blob_offset
+        self.blocks = iter(blocks)
+        self.current = b""
+        self.pos = 0
+
+    def readable(self):
+        return True
+
+    def readinto(self, b):
+        while self.pos >= len(self.current):
+            block = next(self.blocks, None)
+            if block is None:
+                return 0
+            offset, comp, _, codec = block
+            self.f.seek(self.blob_offset + offset)
+            self.current = decompress_block(self.f.read(comp), codec, self.zdict)
+            self.pos = 0
+        n = min(len(b), len(self.current) - self.pos)
+        b[:n] = self.current[self.pos:self.pos + n]
+        self.pos += n
+        return n
+
+
+class SetupPayload:
+    """Parsed container of a previous setup, as written by pack.py."""
+
+    def __init__(self, path: str):
+        self.path = path
+        with open(path, "rb") as f:
+            f.seek(-TRAILER_STRUCT.size, os.SEEK_END)
+            blob_size, sections_size, meta_size, magic_offset = TRAILER_STRUCT.unpack(
+                f.read(TRAILER_STRUCT.size))
+            f.seek(magic_offset)
+            if f.read(len(MAGIC)) != MAGIC:
+                raise ValueError(f"{path}: not a MIKOSETUP payload")
+            self.algo = f.read(4)
+            self.blob_offset = f.tell()
+            self.blob_size = blob_size
+            f.seek(self.blob_offset + blob_size)
+            self.sections = parse_sections(f.read(sections_size))
+            self.metadata = f.read(meta_size).decode("utf-8", "replace")
+        # path -> (size, sha256)
+        self.hashes = {}
+        table = self.sections.get(b"HASH", b"")
+        if len(table) >= 8:
+            (count,) = struct.unpack_from("<Q", table, 0)
+            p = 8
+            for _ in range(count):
+                size, digest, plen = HASH_ENTRY.unpack_from(table, p)
+                p += HASH_ENTRY.size
+                self.hashes[table[p:p + plen].decode("utf-8")] = (size, digest)
+                p += plen
+
+    def _tar_stream(self, f):
+        if self.algo == b"BLKS":
+            raw = _BlockReader(f, self.blob_offset, parse_blocks(self.sections.get(b"BIDX", b"")),
+                               self.sections.get(b"DICT"))
+            return io.BufferedReader(raw, 1 << 20)
+        raw = io.BufferedReader(_BlobReader(f, self.blob_offset, self.blob_size), 1 << 20)
+        return lzma.LZMAFile(raw) if self.algo == b"LZMA" else raw
+
+    def extract(self, wanted, dest_dir: str):
+        """Streams the old blob once and writes the named files under dest_dir."""
+        with open(self.path, "rb") as f:
+            with tarfile.open(fileobj=self._tar_stream(f), mode="r|") as tar:
+                for member in tar:
+                    if member.isfile() and member.name in wanted:
+                        dest = os.path.join(dest_dir, member.name)
+                        os.makedirs(os.path.dirname(dest), exist_ok=True)
+                        with tar.extractfile(member) as src, open(dest, "wb") as dst:
+                            while True:
+                                buf = src.read(1 << 20)
+                                if not buf:
+                                    break
+                                dst.write(buf)
+
+
+def build_patch_section(bases, removed) -> bytes:
+    """bases: [(path, size, sha256)] every delta reads; removed: [path] dropped since the base."""
+    parts = [struct.pack("<Q", len(bases))]
+    for path, size, digest in bases:
+        raw = path.encode("utf-8")
+        parts.append(HASH_ENTRY.pack(size, digest, len(raw)))
+        parts.append(raw)
+    parts.append(struct.pack("<Q", len(removed)))
+    for path in removed:
+        raw = path.encode("utf-8")
+        parts.append(struct.pack("<H", len(raw)))
+        parts.append(raw)
+    payload = b"".join(parts)
+    return SECTION_HEADER.pack(b"PTCH", 0, len(payload)) + payload
@@ -0,0 +1,85 @@
+# Shared deflate dictionary for the payload's small text files (see pack.py).
+#
+# Training is a simplified COVER: sample files are cut into fixed segments, each segment is
+# scored by how many sample files contain its 8-byte substrings, and the best segments are
+# picked greedily (discounting substrings already covered). The most valuable segments go
+# last, nearest to the data, where deflate's distance codes are cheapest.
+
+import collections
+import heapq
+import os
+
+DICT_SIZE = 32 * 1024  # deflate's window; anything earlier is out of reach
+MIN_DICT_SIZE = 4 * 1024
+DICT_RATIO = 16  # corpus bytes per dictionary byte; a larger dictionary costs more than it saves
+SEGMENT = 64
+GRAM = 8
+SAMPLE_BUDGET = 2 * 1024 * 1024
+MIN_SAMPLES = 32
+
+# Small files of these kinds share the dictionary
+TEXT_EXTENSIONS = {
+    ".json", ".xml", ".ts", ".js", ".mjs", ".cjs", ".css", ".html", ".htm", ".md", ".txt",
+    ".properties", ".yaml", ".yml", ".toml", ".ini", ".svg", ".map", ".nls", ".strings",
+    ".resx", ".xaml", ".plist", ".csv", ".py", ".sh", ".cmd", ".bat", ".ps1",
+}
+SMALL_TEXT_MAX = 16 * 1024
+
+
+def is_small_text(path: str, size: int) -> bool:
+    return 0 < size <= SMALL_TEXT_MAX and os.path.splitext(path)[1].lower() in TEXT_EXTENSIONS
+
+
+def _grams(data: bytes):
+    return {data[i:i + GRAM] for i in range(len(data) - GRAM + 1)}
+
+
+def train(paths, size: int = None):
+    """Returns a dictionary trained on `paths`, or None when there is too little to learn from.
+    Without `size`, the dictionary is sized to the corpus (see DICT_RATIO) within deflate's window."""
+    if len(paths) < MIN_SAMPLES:
+        return None
+    total = sum(os.path.getsize(p) for p in paths)
+    if size is None:
+        size = min(DICT_SIZE, max(MIN_DICT_SIZE, total // DICT_RATIO))
+    # Evenly spaced sample within the budget, so one directory does not dominate
+    step = max(1, -(-total // SAMPLE_BUDGET))
+    samples = []
+    for p in paths[::step]:
+        with open(p, "rb") as f:
+            samples.append(f.read())
+
+    freq = collections.Counter()
+    for s in samples:
+        freq.update(_grams(s))
+
+    def score(seg):
+        return sum(freq[g] for g in _grams(seg) if freq[g] > 1)
+
+    heap = []
+    for s in samples:
+        for off in range(0, len(s), SEGMENT):
+            seg = s[off:off + SEGMENT]
+            sc = score(seg)
+            if sc:
+                heap.append((-sc, len(heap), seg))
+    heapq.heapify(heap)
+
+    chosen = []
+    used = 0
+    while heap and used < size:
+        neg, order, seg = heapq.heappop(heap)
+        # Lazy greedy: rescore against what is already covered before accepting
+        sc = score(seg)
+        if not sc:
+            continue
+        if heap and sc < -heap[0][0]:
+            heapq.heappush(heap, (-sc, order, seg))
+            continue
+        chosen.append(seg)
+        used += len(seg)
+        for g in _grams(seg):
+            freq[g] = 0
+    if not chosen:
+        return None
+    return b"".join(reversed(chosen))[-size:]
@@ -1,33 +1,103 @@
 #!/usr/bin/env python3
 # Minimal packer: bundles a directory tree and metadata into a single self-extracting EXE
 # by appending an LZMA-compressed TAR to a bootstrap executable and writing a small trailer.
+# The TAR is cut into fixed-size blocks that are compressed concurrently as independent
+# .xz streams; their concatenation is still a valid .xz file, and a block index section
+# records where each one starts. Archiving, compression and output are streamed, so memory
+# stays bounded by block size times the number of blocks in flight.
+# Block boundaries fall on entry boundaries chosen from the entry names, so an edit only
+# changes the blocks around it; compressed blocks are cached on disk by content hash and
+# reused by the next build.
+# With --patch-from the output is a patch payload against an older setup instead: only
+# changed files are carried, large modified ones as binary deltas (see delta.py).
+# Each block carries its own codec: entries whose sample barely compresses are stored (each
+# in blocks of its own), moderately compressible ones use deflate, and the rest LZMA (see
+# choose_codec()).
+# With --page-align, zero padding between blocks puts the data of stored entries, and the
+# blocks of large ones, at 4 KiB-aligned offsets of the setup file, where the installer
+# maps or clones them instead of reading them.
+# PE and ELF executables get blocks of their own with a BCJ filter ahead of LZMA2.
+# Small text files go into short deflate blocks primed with a dictionary trained on them
+# (see dictionary.py) and stored once in the DICT section, as long as the dictionary pays
+# for itself; otherwise they are plain deflate and there is no DICT section.
+# Entries are ordered by --order: by coding and extension (the default, for ratio and fewer
+# block cuts), by directory (walk order, for write locality), or by a recorded first-launch
+# access profile so the files MikoIDE opens at startup are decoded first.
 
 import argparse
+import collections
+import concurrent.futures
+import hashlib
 import io
 import os
+import posixpath
+import shutil
 import sys
 import tarfile
 import lzma
 import struct
+import threading
 import time
+import tempfile
+import zlib
+
+import delta
+import dictionary
+from payload_format import (
+    ALGO, BCJ_ARM64, BCJ_NAMES, BCJ_RISCV, BCJ_X86, BLOCK_ENTRY, BLOCK_ENTRY_ALIGNED, BLOCK_ENTRY_START,
+    CODEC_DEFLATE, CODEC_DEFLATE_DICT, CODEC_LZMA,
+    CODEC_STORE, HASH_ENTRY, LZMA_PRESET, MAGIC, PAGE_ALIGN, PLAN_HEADER, SECTION_HEADER, TRAILER_STRUCT,
+    bcj_encoder, compress_block, decompress_block)
 
 try:
     import tomllib  # Python 3.11+
 except Exception:
     tomllib = None
 
-MAGIC = b"MIKOSETUP\0"
-ALGO = b"LZMA"  # 4 bytes
-TRAILER_STRUCT = struct.Struct("<Q Q Q")  # (blob_size, meta_size, magic_offset)
+DEFAULT_BLOCK_SIZE = 16 * 1024 * 1024
+# Part of every cache key: bump when the block encoding changes
+CACHE_SETTINGS = f"xz-preset{LZMA_PRESET}-v4".encode("ascii")
+# An entry name ends a block (once it holds a quarter of --block-size) when its CRC-32 is
+# divisible by this, so boundaries resynchronise right after an inserted or resized file
+BOUNDARY_MODULUS = 8
+
+# Files below this stay in the shared LZMA blocks, where solid compression helps them most
+CODEC_MIN_SIZE = 64 * 1024
+# Formats that are compressed already; sampling would only confirm it
+STORED_EXTENSIONS = {
+    ".png", ".jpg", ".jpeg", ".gif", ".webp", ".ico", ".zip", ".jar", ".vsix", ".nupkg",
+    ".gz", ".tgz", ".bz2", ".xz", ".7z", ".zst", ".br", ".woff", ".woff2", ".mp3", ".mp4",
+    ".ogg", ".webm", ".pdf",
+}
+# zlib level-1 ratio of a sample: above STORE_RATIO store, above DEFLATE_RATIO deflate
+STORE_RATIO = 0.95
+DEFLATE_RATIO = 0.80
+SAMPLE_SIZE = 64 * 1024
+# Dictionary blocks stay short: deflate only sees the dictionary within its 32 KiB window
+DICT_BLOCK_SIZE = 64 * 1024
+
+
+class HashingReader:
+    """File wrapper that hashes whatever tarfile reads through it."""
+
+    def __init__(self, f):
+        self.f = f
+        self.sha = hashlib.sha256()
+
+    def read(self, n=-1):
+        data = self.f.read(n)
+        self.sha.update(data)
+        return data
 
 
-def build_metadata(app_name: str, app_version: str, install_dir: str):
+def build_metadata(app_name: str, app_version: str, install_dir: str, extra=None):
     meta = {
         "name": app_name,
         "version": app_version,
         "install_dir": install_dir,
         "created": int(time.time()),
     }
+    meta.update(extra or {})
     # Serialize to TOML-like bytes (without external deps); if tomllib unavailable for dump, write simple lines
     lines = []
     for k, v in meta.items():
@@ -38,28 +108,597 @@ def build_metadata(app_name: str, app_version: str, install_dir: str):
     return ("".join(lines)).encode("utf-8")
 
 
-def add_dir_to_tar(tar: tarfile.TarFile, root: str, base: str = ""):
+def build_section(tag: bytes, payload: bytes) -> bytes:
+    return SECTION_HEADER.pack(tag, 0, len(payload)) + payload
+
+
+def build_hash_section(hashes):
+    """hashes: list of (arcname, size, sha256 digest) for every regular file in the TAR."""
+    parts = [struct.pack("<Q", len(hashes))]
+    for arc, size, digest in hashes:
+        path = arc.encode("utf-8")
+        parts.append(HASH_ENTRY.pack(size, digest, len(path)))
+        parts.append(path)
+    return build_section(b"HASH", b"".join(parts))
+
+
+class InstallPlan:
+    """Totals for the PLAN section, collected as entries are archived."""
+
+    def __init__(self):
+        self.file_count = 0
+        self.total_bytes = 0
+        self.largest = 0
+        self.dirs = []
+
+    def add_file(self, size: int):
+        self.file_count += 1
+        self.total_bytes += size
+        self.largest = max(self.largest, size)
+
+    def build_section(self, archive_bytes: int) -> bytes:
+        parts = [PLAN_HEADER.pack(self.file_count, self.total_bytes, self.largest, archive_bytes,
+                                  len(self.dirs))]
+        for d in self.dirs:
+            raw = d.encode("utf-8")
+            parts.append(struct.pack("<H", len(raw)))
+            parts.append(raw)
+        return build_section(b"PLAN", b"".join(parts))
+
+
+def build_block_index_section(blocks):
+    """blocks: list of (blob_offset, compressed_size, uncompressed_size, codec, flags) in blob order."""
+    parts = [struct.pack("<Q", len(blocks))]
+    for offset, comp, raw, codec, flags in blocks:
+        parts.append(BLOCK_ENTRY.pack(offset, comp, raw, codec, flags))
+    return build_section(b"BIDX", b"".join(parts))
+
+
+def choose_codec(path: str, size: int) -> bytes:
+    """Estimates compressibility from up to three samples (start, middle, end)."""
+    if size < CODEC_MIN_SIZE:
+        return CODEC_LZMA
+    if os.path.splitext(path)[1].lower() in STORED_EXTENSIONS:
+        return CODEC_STORE
+    sample = bytearray()
+    with open(path, "rb") as f:
+        for off in sorted({0, max(0, size // 2 - SAMPLE_SIZE // 2), max(0, size - SAMPLE_SIZE)}):
+            f.seek(off)
+            sample += f.read(SAMPLE_SIZE)
+    ratio = len(zlib.compress(sample, 1)) / max(len(sample), 1)
+    if ratio > STORE_RATIO:
+        return CODEC_STORE
+    if ratio > DEFLATE_RATIO:
+        return CODEC_DEFLATE
+    return CODEC_LZMA
+
+
+# PE machine / ELF e_machine -> BCJ filter
+PE_MACHINES = {0x014C: BCJ_X86, 0x8664: BCJ_X86, 0xAA64: BCJ_ARM64}
+ELF_MACHINES = {0x03: BCJ_X86, 0x3E: BCJ_X86, 0xB7: BCJ_ARM64, 0xF3: BCJ_RISCV}
+
+
+def executable_filter(path: str) -> int:
+    """BCJ filter for a PE or little-endian ELF executable, or 0."""
+    with open(path, "rb") as f:
+        head = f.read(64)
+        if head[:2] == b"MZ" and len(head) >= 64:
+            (pe_off,) = struct.unpack_from("<I", head, 0x3C)
+            f.seek(pe_off)
+            pe = f.read(6)
+            if len(pe) == 6 and pe[:4] == b"PE\0\0":
+                return PE_MACHINES.get(struct.unpack_from("<H", pe, 4)[0], 0)
+        elif head[:4] == b"\x7fELF" and len(head) >= 20 and head[5] == 1:
+            return ELF_MACHINES.get(struct.unpack_from("<H", head, 18)[0], 0)
+    return 0
+
+
+def choose_coding(path: str, size: int, small_codec: bytes = None):
+    """(codec, bcj filter) for one file; `small_codec`, when given, codes small text files."""
+    if small_codec and dictionary.is_small_text(path, size):
+        return small_codec, 0
+    codec = choose_codec(path, size)
+    if codec == CODEC_LZMA and size >= CODEC_MIN_SIZE:
+        bcj = executable_filter(path)
+        if bcj and bcj_encoder(bcj):
+            return codec, bcj
+    return codec, 0
+
+
+def coding_name(codec: bytes, bcj: int) -> str:
+    return codec.decode() + (f"+{BCJ_NAMES[bcj]}" if bcj else "")
+
+
+def encode_block(data, codec: bytes, bcj: int = 0, zdict: bytes = None):
+    """Returns (payload, codec); falls back to storing when coding would not shrink it."""
+    comp = compress_block(data, codec, bcj, zdict)
+    if codec != CODEC_STORE and len(comp) >= len(data):
+        return bytes(data), CODEC_STORE
+    return comp, codec
+
+
+def dictionary_pays_off(paths, zdict: bytes, workers: int):
+    """Codes the small text files in `paths` the way BlockWriter groups them, with and without
+    `zdict`. Returns (dictionary-coded bytes plus the dictionary itself, plain deflate bytes)."""
+    ordered = sorted(paths, key=lambda p: (os.path.splitext(p)[1].lower(), os.path.basename(p), p))
+    blocks = []
+    buf = bytearray()
+    for path in ordered:
+        with open(path, "rb") as f:
+            data = f.read()
+        if buf and len(buf) + len(data) > DICT_BLOCK_SIZE:
+            blocks.append(bytes(buf))
+            buf = bytearray()
+        buf += data
+    if buf:
+        blocks.append(bytes(buf))
+
+    def sizes(block):
+        return (len(encode_block(block, CODEC_DEFLATE_DICT, zdict=zdict)[0]),
+                len(encode_block(block, CODEC_DEFLATE)[0]))
+
+    with concurrent.futures.ThreadPoolExecutor(max_workers=workers) as pool:
+        coded = list(pool.map(sizes, blocks))
+    return sum(d for d, _ in coded) + len(zdict), sum(p for _, p in coded)
+
+
+class BlockCache:
+    """On-disk store of compressed blocks keyed by SHA-256 of the settings and the raw block."""
+
+    def __init__(self, root: str):
+        self.root = root
+        os.makedirs(root, exist_ok=True)
+
+    def _path(self, key: str) -> str:
+        return os.path.join(self.root, key[:2], key + ".blk")
+
+    def compress(self, data, codec: bytes, bcj: int = 0, zdict: bytes = None):
+        """Returns (payload, codec, cache_hit). Entries hold the final codec, then the payload."""
+        dict_id = hashlib.sha256(zdict).digest() if codec == CODEC_DEFLATE_DICT else b""
+        key = hashlib.sha256(CACHE_SETTINGS + codec + bytes([bcj]) + dict_id + data).hexdigest()
+        path = self._path(key)
+        try:
+            with open(path, "rb") as f:
+                entry = f.read()
+            os.utime(path)  # keep recently used blocks out of prune()
+            return entry[4:], entry[:4], True
+        except OSError:
+            pass
+        comp, codec = encode_block(data, codec, bcj, zdict)
+        os.makedirs(os.path.dirname(path), exist_ok=True)
+        tmp = f"{path}.{os.getpid()}.{threading.get_ident()}.tmp"
+        with open(tmp, "wb") as f:
+            f.write(codec)
+            f.write(comp)
+        os.replace(tmp, path)
+        return comp, codec, False
+
+    def prune(self, max_age_days: float) -> int:
+        cutoff = time.time() - max_age_days * 86400
+        removed = 0
+        for dirpath, _, filenames in os.walk(self.root):
+            for fn in filenames:
+                full = os.path.join(dirpath, fn)
+                try:
+                    if os.stat(full).st_mtime < cutoff:
+                        os.remove(full)
+                        removed += 1
+                except OSError:
+                    pass
+        return removed
+
+
+class BlockWriter:
+    """Write-only file object for tarfile that compresses and emits blocks as they fill.
+
+    Full blocks are compressed on `workers` threads (liblzma releases the GIL, so threads
+    scale without copying blocks into worker processes) and written to `out` in input
+    order. At most 2 * workers blocks are buffered or in flight at any time.
+    Callers bracket each TAR entry with begin_entry()/end_entry() so blocks can be cut on
+    entry boundaries and by codec; blocks found in `cache` are reused instead of compressed.
+    Only entries of at least block_size are split across blocks, and the block after such an
+    entry starts fresh, so every other block begins on a TAR header and the installer can
+    unpack those groups of blocks on separate threads.
+    With `align`, blocks of stored entries and of entries of at least block_size are padded
+    to start (stored: their entry's data) on an `align` boundary of the file `out` writes
+    into, counted from where `out` stands when the writer is created.
+    Every block is also decoded once, timed, to report what the codec choice saves.
+    """
+
+    def __init__(self, out, block_size: int, workers: int, baseline=None, cache=None, zdict=None,
+                 keep_dict_blocks=False, align: int = 0, small_codec: bytes = None):
+        self.out = out
+        self.base = out.tell()
+        self.align = align
+        # Bytes from a block's start to the data to align, for the entry being buffered;
+        # None when its blocks are not aligned
+        self.align_lead = None
+        self.padding = 0
+        self.aligned_blocks = 0
+        self.zdict = zdict
+        # Codec for small text files (see choose_coding()); dictionary-coded whenever there is one
+        self.small_codec = CODEC_DEFLATE_DICT if zdict is not None else small_codec
+        # Raw dictionary-coded blocks, kept only for --compare-dict
+        self.dict_blocks = [] if keep_dict_blocks else None
+        self.block_size = block_size
+        self.min_block = max(block_size // 4, 1)
+        self.cache = cache
+        self.cache_hits = 0
+        self.cache_hit_bytes = 0
+        self.pool = concurrent.futures.ThreadPoolExecutor(max_workers=workers)
+        self.max_pending = 2 * workers
+        self.pending = collections.deque()
+        self.buf = bytearray()
+        self.blocks = []  # (blob_offset, compressed_size, uncompressed_size, codec, flags)
+        self.coding = (CODEC_LZMA, 0)  # (codec, bcj filter) of the block being filled
+        self.at_entry = True  # the buffered block begins on a TAR header
+        self.in_large = False  # inside an entry that is split across blocks
+        # coding -> [blocks, raw bytes, coded bytes, decode seconds]
+        self.codec_stats = collections.defaultdict(lambda: [0, 0, 0, 0.0])
+        self.raw_size = 0
+        self.comp_size = 0
+        self.blob_size = 0  # comp_size plus alignment padding
+        # Optional single-stream compressor fed the same bytes, for speedup reporting
+        self.baseline = baseline
+        self.baseline_size = 0
+        self.baseline_seconds = 0.0
+
+    def write(self, data) -> int:
+        n = len(data)
+        self.raw_size += n
+        if self.baseline is not None:
+            t0 = time.perf_counter()
+            self.baseline_size += len(self.baseline.compress(data))
+            self.baseline_seconds += time.perf_counter() - t0
+        self.buf += data
+        # Headers of small entries may run past block_size until the next boundary; only
+        # large entries are cut mid-way (and anything that somehow grows far past it)
+        limit = self.block_size if self.in_large else 2 * self.block_size
+        while len(self.buf) >= limit + (self.align_lead or 0):
+            # An aligned stored entry's first block also holds its header, so the blocks
+            # after it start on aligned data too
+            size = self.block_size + (self.align_lead or 0)
+            self._submit(bytes(self.buf[:size]), self.coding, self.at_entry)
+            del self.buf[:size]
+            self.at_entry = False
+            if self.align_lead:
+                self.align_lead = 0
+        return n
+
+    def tell(self) -> int:
+        return self.raw_size
+
+    def begin_entry(self, size: int, coding=(CODEC_LZMA, 0), header: int = 0):
+        """`header`: bytes the TAR writes ahead of the entry's data, extended headers included."""
+        # Large files start their own block so their chunks line up with their content, and
+        # a block never mixes codecs or filters. Stored files do too: their body then sits
+        # right behind their header at the start of a block, where the installer copies it
+        # from the setup file to the destination without reading it.
+        if size >= self.block_size or coding != self.coding or len(self.buf) + size > self.block_size \
+                or coding[0] == CODEC_STORE:
+            self.cut()
+        if not self.buf:
+            # The entry starts a block, which is aligned for it or not at all
+            self.align_lead = None
+            if self.align and coding[0] == CODEC_STORE:
+                self.align_lead = header
+            elif self.align and size >= self.block_size:
+                self.align_lead = 0
+        elif coding[0] == CODEC_DEFLATE_DICT and len(self.buf) + size > DICT_BLOCK_SIZE:
+            self.cut()
+        self.coding = coding
+        self.in_large = size >= self.block_size
+
+    def end_entry(self, name: str):
+        if self.in_large or (len(self.buf) >= self.min_block and
+                             zlib.crc32(name.encode("utf-8")) % BOUNDARY_MODULUS == 0):
+            self.cut()
+            self.align_lead = None
+        self.in_large = False
+
+    def cut(self):
+        """Ends the current block; callers only cut between entries."""
+        if self.buf:
+            self._submit(bytes(self.buf), self.coding, self.at_entry)
+            self.buf = bytearray()
+        self.at_entry = True
+
+    def _compress(self, block: bytes, coding):
+        codec, bcj = coding
+        if self.cache is not None:
+            comp, codec, hit = self.cache.compress(block, codec, bcj, self.zdict)
+        else:
+            (comp, codec), hit = encode_block(block, codec, bcj, self.zdict), False
+        t0 = time.perf_counter()
+        decompress_block(comp, codec, self.zdict)
+        return comp, codec, hit, time.perf_counter() - t0
+
+    def _submit(self, block: bytes, coding, at_entry: bool):
+        while len(self.pending) >= self.max_pending:
+            self._drain_one()
+        if self.dict_blocks is not None and coding[0] == CODEC_DEFLATE_DICT:
+            self.dict_blocks.append(block)
+        flags = BLOCK_ENTRY_START if at_entry else 0
+        self.pending.append((self.pool.submit(self._compress, block, coding), len(block), coding[1], flags,
+                             self.align_lead))
+
+    def _drain_one(self):
+        future, raw, bcj, flags, lead = self.pending.popleft()
+        comp, codec, hit, decode_seconds = future.result()
+        if hit:
+            self.cache_hits += 1
+            self.cache_hit_bytes += raw
+        if lead is not None:
+            # A coded block has no data to line up but itself
+            lead = lead if codec == CODEC_STORE else 0
+            pad = -(self.base + self.blob_size + lead) % self.align
+            self.out.write(bytes(pad))
+            self.blob_size += pad
+            self.padding += pad
+            self.aligned_blocks += 1
+            flags |= BLOCK_ENTRY_ALIGNED
+        self.blocks.append((self.blob_size, len(comp), raw, codec, flags))
+        self.out.write(comp)
+        self.blob_size += len(comp)
+        self.comp_size += len(comp)
+        stats = self.codec_stats[(codec, bcj if codec == CODEC_LZMA else 0)]
+        stats[0] += 1
+        stats[1] += raw
+        stats[2] += len(comp)
+        stats[3] += decode_seconds
+
+    def report_codecs(self):
+        for (codec, bcj), (count, raw, comp, secs) in sorted(self.codec_stats.items()):
+            print(f"  {coding_name(codec, bcj)}: {count} blocks, {raw} -> {comp} bytes, "
+                  f"decode {secs * 1000:.1f} ms")
+        lz = self.codec_stats.get((CODEC_LZMA, 0))
+        if lz and lz[1] and lz[3] > 0:
+            # What the other blocks would have cost at the plain LZMA blocks' decode rate
+            rate = lz[3] / lz[1]
+            saved = sum(raw * rate - secs for (codec, _), (_, raw, _, secs) in self.codec_stats.items()
+                        if codec != CODEC_LZMA)
+            print(f"  estimated decode time saved vs all-LZMA: {saved * 1000:.1f} ms")
+
+    def report_dictionary(self):
+        """Dictionary-coded small files against solid LZMA and plain deflate over the same bytes."""
+        if not self.dict_blocks:
+            print("  no dictionary-coded blocks")
+            return
+        raw = b"".join(self.dict_blocks)
+
+        def timed(fn, *a):
+            t0 = time.perf_counter()
+            fn(*a)
+            return time.perf_counter() - t0
+
+        solid = compress_block(raw, CODEC_LZMA)
+        plain = [compress_block(b, CODEC_DEFLATE) for b in self.dict_blocks]
+        primed = [compress_block(b, CODEC_DEFLATE_DICT, zdict=self.zdict) for b in self.dict_blocks]
+        rows = [
+            ("solid LZMA", len(solid), timed(decompress_block, solid, CODEC_LZMA)),
+            ("deflate blocks", sum(map(len, plain)),
+             sum(timed(decompress_block, c, CODEC_DEFLATE) for c in plain)),
+            ("deflate+dict blocks", sum(map(len, primed)) + len(self.zdict),
+             sum(timed(decompress_block, c, CODEC_DEFLATE_DICT, self.zdict) for c in primed)),
+        ]
+        print(f"Small text: {len(raw)} bytes in {len(self.dict_blocks)} blocks, "
+              f"{len(self.zdict)}-byte dictionary")
+        for name, size, secs in rows:
+            print(f"  {name:20s} {size:10d} bytes ({100.0 * size / len(raw):5.1f}%)  "
+                  f"decode {secs * 1000:7.1f} ms ({len(raw) / max(secs, 1e-9) / 2**20:7.1f} MiB/s)")
+
+    def finish(self):
+        if self.buf or not self.blocks and not self.pending:
+            self._submit(bytes(self.buf), self.coding, self.at_entry)
+            self.buf = bytearray()
+        while self.pending:
+            self._drain_one()
+        self.pool.shutdown()
+        if self.baseline is not None:
+            t0 = time.perf_counter()
+            self.baseline_size += len(self.baseline.flush())
+            self.baseline_seconds += time.perf_counter() - t0
+
+
+def source_mtime(st_mtime: float) -> int:
+    # Honour SOURCE_DATE_EPOCH so rebuilt-but-identical files produce identical blocks
+    epoch = os.environ.get("SOURCE_DATE_EPOCH")
+    return min(int(st_mtime), int(epoch)) if epoch else int(st_mtime)
+
+
+def walk_tree(root: str, base: str = ""):
+    """Yields (arcname, full_path, is_dir) in sorted order so unchanged trees archive to
+    identical bytes."""
     base = (os.path.normpath(base) if base else "")
     for dirpath, dirnames, filenames in os.walk(root):
+        dirnames.sort()
         rel = os.path.relpath(dirpath, root)
         arcdir = (os.path.join(base, rel) if rel != "." else base)
         # Ensure directory entry (skip root when arcdir is empty)
         if arcdir:
-            ti = tarfile.TarInfo(arcdir.replace("\\", "/") + "/")
+            yield arcdir.replace("\\", "/"), dirpath, True
+        for fn in sorted(filenames):
+            full = os.path.join(dirpath, fn)
+            yield (os.path.join(arcdir, fn).replace("\\", "/") if arcdir else fn), full, False
+
+
+ORDER_STRATEGIES = ("type", "directory", "profile")
+
+
+def load_access_profile(path: str):
+    """Arcnames in first-access order, one per line; blank lines and '#' comments are skipped.
+    Typically a file-access trace of a first launch, reduced to paths under the install dir."""
+    names = []
+    with open(path, "r", encoding="utf-8") as f:
+        for line in f:
+            line = line.strip().replace("\\", "/")
+            if line and not line.startswith("#"):
+                names.append(line[2:] if line.startswith("./") else line)
+    return names
+
+
+def order_entries(root: str, base: str = "", order: str = "type", profile=None, small_codec=None):
+    """walk_tree() entries as (arcname, full_path, is_dir, coding), rearranged by `order`.
+
+    "directory" keeps walk order. The other strategies emit every directory first (the
+    installer creates them all up front anyway) and then the files: "type" groups them by
+    coding, extension and name, so similar content shares blocks and blocks are cut less
+    often; "profile" puts the files listed in `profile` first, in that order, and the
+    rest as "type" does. Codings are computed once here and reused by add_dir_to_tar().
+    """
+    entries = [(arc, full, is_dir, None) for arc, full, is_dir in walk_tree(root, base)]
+    if order == "directory":
+        return entries
+    dirs = [e for e in entries if e[2]]
+    files = [(arc, full, False, choose_coding(full, os.path.getsize(full), small_codec))
+             for arc, full, is_dir, _ in entries if not is_dir]
+
+    def type_key(e):
+        arc, _, _, coding = e
+        return coding, posixpath.splitext(arc)[1].lower(), posixpath.basename(arc), arc
+
+    rank = {name: i for i, name in enumerate(profile or ())} if order == "profile" else {}
+    hot = sorted((e for e in files if e[0] in rank), key=lambda e: rank[e[0]])
+    rest = sorted((e for e in files if e[0] not in rank), key=type_key)
+    return dirs + hot + rest
+
+
+def hash_tree(root: str, base: str = ""):
+    """(arcname, size, sha256) for each file, without archiving anything."""
+    hashes = []
+    for arc, full, is_dir in walk_tree(root, base):
+        if is_dir:
+            continue
+        sha = hashlib.sha256()
+        with open(full, "rb") as f:
+            for buf in iter(lambda: f.read(1 << 20), b""):
+                sha.update(buf)
+        hashes.append((arc, os.path.getsize(full), sha.digest()))
+    return hashes
+
+
+def add_dir_to_tar(tar: tarfile.TarFile, root: str, base: str = "", writer=None, include=None,
+                   plan=None, order: str = "directory", profile=None):
+    """Adds the tree to the TAR and returns (arcname, size, sha256) for each file added.
+
+    `include`, when given, limits the files added to those arcnames; directories are always
+    added so new ones get created. Entries are also counted into `plan` when given, and
+    arranged by `order` (see order_entries()).
+    """
+    hashes = []
+    small_codec = writer.small_codec if writer is not None else None
+    for arc, full, is_dir, coding in order_entries(root, base, order, profile, small_codec):
+        st = os.stat(full)
+        if is_dir:
+            ti = tarfile.TarInfo(arc + "/")
             ti.type = tarfile.DIRTYPE
-            ti.mtime = int(time.time())
+            ti.mtime = source_mtime(st.st_mtime)
             ti.mode = 0o755
             tar.addfile(ti)
-        for fn in filenames:
-            full = os.path.join(dirpath, fn)
-            arc = os.path.join(arcdir, fn).replace("\\", "/") if arcdir else fn
-            st = os.stat(full)
-            ti = tarfile.TarInfo(arc)
-            ti.size = st.st_size
-            ti.mtime = int(st.st_mtime)
-            ti.mode = 0o644
-            with open(full, "rb") as f:
-                tar.addfile(ti, f)
+            if writer:
+                writer.end_entry(ti.name)
+            if plan:
+                plan.dirs.append(arc)
+            continue
+        if include is not None and arc not in include:
+            continue
+        ti = tarfile.TarInfo(arc)
+        ti.size = st.st_size
+        ti.mtime = source_mtime(st.st_mtime)
+        ti.mode = 0o644
+        if writer:
+            writer.begin_entry(st.st_size, coding or choose_coding(full, st.st_size, small_codec),
+                               len(ti.tobuf(tar.format, tar.encoding, tar.errors)))
+        with open(full, "rb") as f:
+            reader = HashingReader(f)
+            tar.addfile(ti, reader)
+        if writer:
+            writer.end_entry(arc)
+        if plan:
+            plan.add_file(st.st_size)
+        hashes.append((arc, st.st_size, reader.sha.digest()))
+    return hashes
+
+
+def time_extraction(blob: bytes, blocks, zdict, dest: str, hot):
+    """Decodes and writes an in-memory blob under `dest`. Returns (total seconds, seconds until
+    every file in `hot` was written, or None)."""
+    index = [(offset, comp, raw, codec) for offset, comp, raw, codec, _ in blocks]
+    waiting = set(hot)
+    ready = None
+    t0 = time.perf_counter()
+    stream = io.BufferedReader(delta._BlockReader(io.BytesIO(blob), 0, index, zdict), 1 << 20)
+    with tarfile.open(fileobj=stream, mode="r|") as tar:
+        for member in tar:
+            target = os.path.join(dest, member.name)
+            if member.isdir():
+                os.makedirs(target, exist_ok=True)
+                continue
+            os.makedirs(os.path.dirname(target), exist_ok=True)
+            with tar.extractfile(member) as src, open(target, "wb") as dst:
+                shutil.copyfileobj(src, dst, 1 << 20)
+            if member.name in waiting:
+                waiting.discard(member.name)
+                if not waiting:
+                    ready = time.perf_counter() - t0
+    return time.perf_counter() - t0, ready
+
+
+def compare_orders(args, zdict, small_codec, cache, profile):
+    """Packs the tree once per ordering strategy into memory and reports size and the time to
+    decode and write it out (plus, given a profile, until the startup files are on disk)."""
+    raw_total = None
+    print("Entry order comparison:")
+    for order in ORDER_STRATEGIES:
+        if order == "profile" and not profile:
+            continue
+        out = io.BytesIO()
+        writer = BlockWriter(out, args.block_size, args.jobs, cache=cache, zdict=zdict,
+                             small_codec=small_codec)
+        with tarfile.open(fileobj=writer, mode="w") as tar:
+            add_dir_to_tar(tar, args.sources_dir, writer=writer, order=order, profile=profile)
+        writer.finish()
+        raw_total = writer.raw_size
+        with tempfile.TemporaryDirectory(dir=args.build_dir) as tmp:
+            seconds, ready = time_extraction(out.getvalue(), writer.blocks, zdict, tmp, profile or ())
+        line = (f"  {order:10s} {writer.comp_size:12d} bytes ({100.0 * writer.comp_size / max(raw_total, 1):5.1f}%) "
+                f"in {len(writer.blocks):5d} blocks, extract {seconds:6.2f} s")
+        if ready is not None:
+            line += f", startup files ready after {ready:6.2f} s"
+        print(line)
+
+
+def plan_patch(args, old):
+    """Compares the tree with the old payload. Returns (full_files, deltas, bases, removed,
+    hashes): files to carry whole, {arcname: delta bytes}, the base files those deltas read,
+    files to delete, and the digests of the complete new tree."""
+    hashes = hash_tree(args.sources_dir)
+    changed = [(arc, size, sha) for arc, size, sha in hashes if old.hashes.get(arc) != (size, sha)]
+    new_names = {arc for arc, _, _ in hashes} | {"metadata.toml"}
+    removed = sorted(arc for arc in old.hashes if arc not in new_names)
+    candidates = [(arc, size, sha) for arc, size, sha in changed
+                  if size >= args.delta_min_size and old.hashes.get(arc, (0,))[0] >= args.delta_min_size]
+
+    deltas = {}
+    bases = []
+    if candidates:
+        with tempfile.TemporaryDirectory(dir=args.build_dir) as tmp:
+            old.extract({arc for arc, _, _ in candidates}, tmp)
+            with concurrent.futures.ProcessPoolExecutor(max_workers=args.jobs) as pool:
+                futures = {arc: pool.submit(delta.make_checked_delta, os.path.join(tmp, arc),
+                                            os.path.join(args.sources_dir, arc), sha)
+                           for arc, _, sha in candidates}
+                for arc, future in futures.items():
+                    d = future.result()
+                    if d is not None:
+                        deltas[arc] = d
+                        base_size, base_sha = old.hashes[arc]
+                        bases.append((arc, base_size, base_sha))
+    full_files = {arc for arc, _, _ in changed if arc not in deltas}
+    print(f"Patch: {len(changed)} changed files ({len(deltas)} as deltas, "
+          f"{sum(len(d) for d in deltas.values())} delta bytes), {len(removed)} removed, "
+          f"{len(hashes) - len(changed)} unchanged")
+    return full_files, deltas, bases, removed, hashes
 
 
 def main():
@@ -72,36 +711,149 @@ def main():
     p.add_argument("--app-version", required=True)
     p.add_argument("--output", required=True)
     p.add_argument("--install-dir", default=r"%LOCALAPPDATA%\\MikoIDE")
+    p.add_argument("--block-size", type=int, default=DEFAULT_BLOCK_SIZE,
+                   help="uncompressed bytes per independently compressed block")
+    p.add_argument("--jobs", type=int, default=os.cpu_count() or 1,
+                   help="compression threads (default: all cores)")
+    p.add_argument("--cache-dir", default=None,
+                   help="compressed block cache (default: <build-dir>/pack-cache; '' disables)")
+    p.add_argument("--cache-max-age-days", type=float, default=14.0,
+                   help="drop cached blocks not used for this many days")
+    p.add_argument("--patch-from", default=None,
+                   help="previous setup executable; writes a patch payload against it")
+    p.add_argument("--delta-min-size", type=int, default=1024 * 1024,
+                   help="changed files at least this large are shipped as binary deltas")
+    p.add_argument("--no-dictionary", action="store_true",
+                   help="do not train a shared dictionary for small text files")
+    p.add_argument("--compare-dict", action="store_true",
+                   help="report dictionary-coded small files against solid LZMA and plain deflate")
+    p.add_argument("--order", choices=ORDER_STRATEGIES, default="type",
+                   help="entry order: by coding and extension, by directory, or by access profile")
+    p.add_argument("--access-profile", default=None,
+                   help="file listing the arcnames read by a first launch, in access order")
+    p.add_argument("--compare-order", action="store_true",
+                   help="report size and extraction time of every ordering strategy")
+    p.add_argument("--page-align", action="store_true",
+                   help="pad blocks so stored and large entries start on 4 KiB boundaries of the setup, "
+                        "for the installer to map or clone them")
+    p.add_argument("--compare-single", action="store_true",
+                   help="also time the old single-stream compression and report the speedup")
     args = p.parse_args()
+    if args.order == "profile" and not args.access_profile:
+        p.error("--order profile needs --access-profile")
+    profile = load_access_profile(args.access_profile) if args.access_profile else None
 
-    # Prepare tar buffer
-    tar_bytes = io.BytesIO()
-    with tarfile.open(fileobj=tar_bytes, mode="w") as tar:
-        add_dir_to_tar(tar, args.sources_dir, base="")
-        # Metadata TOML
-        meta = build_metadata(args.app_name, args.app_version, args.install_dir)
-        ti = tarfile.TarInfo("metadata.toml")
-        ti.size = len(meta)
-        ti.mtime = int(time.time())
-        ti.mode = 0o644
-        tar.addfile(ti, io.BytesIO(meta))
-    tar_data = tar_bytes.getvalue()
-
-    # Compress with LZMA
-    lz_data = lzma.compress(tar_data, preset=6)
+    extra_meta = {}
+    patch = None
+    if args.patch_from:
+        old = delta.SetupPayload(args.patch_from)
+        if not old.hashes or b"PTCH" in old.sections:
+            print(f"{args.patch_from} is not a full setup with file hashes; cannot patch against it",
+                  file=sys.stderr)
+            return 1
+        patch = plan_patch(args, old)
+        for line in old.metadata.splitlines():
+            if line.startswith("version = "):
+                extra_meta["patch_base"] = line.split("=", 1)[1].strip().strip('"')
 
     os.makedirs(os.path.dirname(args.output), exist_ok=True)
     with open(args.bootstrap_exe, "rb") as f_boot, open(args.output, "wb") as f_out:
-        boot = f_boot.read()
-        f_out.write(boot)
+        shutil.copyfileobj(f_boot, f_out)
         magic_offset = f_out.tell()
         f_out.write(MAGIC)
         f_out.write(ALGO)
-        f_out.write(lz_data)
-        meta_bytes = build_metadata(args.app_name, args.app_version, args.install_dir)
+
+        # Archive and compress straight into the output, one independent stream per block
+        t0 = time.perf_counter()
+        baseline = lzma.LZMACompressor(preset=LZMA_PRESET) if args.compare_single else None
+        cache_dir = args.cache_dir if args.cache_dir is not None else \
+            os.path.join(args.build_dir, "pack-cache")
+        cache = BlockCache(cache_dir) if cache_dir else None
+        zdict = None
+        small_codec = None
+        if not args.no_dictionary:
+            small = [full for arc, full, is_dir in walk_tree(args.sources_dir)
+                     if not is_dir and dictionary.is_small_text(full, os.path.getsize(full))]
+            zdict = dictionary.train(small)
+            if zdict:
+                primed, plain = dictionary_pays_off(small, zdict, args.jobs)
+                print(f"Trained a {len(zdict)}-byte dictionary on {len(small)} small text files: "
+                      f"{primed} bytes with it (dictionary included), {plain} without")
+                if primed >= plain:
+                    print("  dictionary does not pay for itself; small text files use plain deflate")
+                    zdict = None
+                    small_codec = CODEC_DEFLATE
+        writer = BlockWriter(f_out, args.block_size, args.jobs, baseline, cache, zdict,
+                             keep_dict_blocks=args.compare_dict, align=PAGE_ALIGN if args.page_align else 0,
+                             small_codec=small_codec)
+        plan = InstallPlan()
+        with tarfile.open(fileobj=writer, mode="w") as tar:
+            if patch is None:
+                hashes = add_dir_to_tar(tar, args.sources_dir, base="", writer=writer, plan=plan,
+                                        order=args.order, profile=profile)
+            else:
+                full_files, deltas, _, _, hashes = patch
+                add_dir_to_tar(tar, args.sources_dir, base="", writer=writer, include=full_files,
+                               plan=plan, order=args.order, profile=profile)
+                for arc, d in deltas.items():
+                    ti = tarfile.TarInfo(delta.DELTA_PREFIX + arc)
+                    ti.size = len(d)
+                    ti.mtime = int(time.time())
+                    ti.mode = 0o644
+                    writer.begin_entry(len(d))
+                    tar.addfile(ti, io.BytesIO(d))
+                    writer.end_entry(ti.name)
+                    plan.add_file(len(d))
+            # Metadata carries a timestamp; keep it out of the cacheable blocks
+            writer.cut()
+            meta = build_metadata(args.app_name, args.app_version, args.install_dir, extra_meta)
+            writer.begin_entry(len(meta))
+            ti = tarfile.TarInfo("metadata.toml")
+            ti.size = len(meta)
+            ti.mtime = int(time.time())
+            ti.mode = 0o644
+            tar.addfile(ti, io.BytesIO(meta))
+            plan.add_file(len(meta))
+            hashes.append(("metadata.toml", len(meta), hashlib.sha256(meta).digest()))
+        writer.finish()
+        elapsed = time.perf_counter() - t0 - writer.baseline_seconds
+        print(f"Compressed {writer.raw_size} -> {writer.comp_size} bytes in {len(writer.blocks)} "
+              f"blocks with {args.jobs} threads: {elapsed:.2f} s")
+        writer.report_codecs()
+        if writer.align:
+            print(f"  {writer.aligned_blocks} blocks aligned to {writer.align} bytes, "
+                  f"{writer.padding} bytes of padding")
+        if args.compare_dict and zdict:
+            writer.report_dictionary()
+        if args.compare_order:
+            compare_orders(args, zdict, small_codec, cache, profile)
+        if cache is not None:
+            print(f"Block cache: {writer.cache_hits}/{len(writer.blocks)} blocks reused "
+                  f"({writer.cache_hit_bytes} bytes), {cache.prune(args.cache_max_age_days)} "
+                  f"stale entries pruned")
+        if baseline is not None:
+            print(f"Single-stream baseline: {writer.baseline_size} bytes in "
+                  f"{writer.baseline_seconds:.2f} s; "
+                  f"speedup {writer.baseline_seconds / max(elapsed, 1e-9):.2f}x, "
+                  f"size {100.0 * (writer.comp_size - writer.baseline_size) / max(writer.baseline_size, 1):+.2f}%")
+
+        # Per-file digests let the installer verify/repair an install without decompressing
+        sections = build_hash_section(hashes)
+        sections += build_block_index_section(writer.blocks)
+        # Totals and directories the installer can act on before decompressing anything
+        sections += plan.build_section(writer.raw_size)
+        # Blocks that did not shrink under the dictionary were stored; without any left, the
+        # dictionary would only take up space
+        if zdict and writer.codec_stats.get((CODEC_DEFLATE_DICT, 0)):
+            sections += build_section(b"DICT", zdict)
+        if patch is not None:
+            _, _, bases, removed, _ = patch
+            sections += delta.build_patch_section(bases, removed)
+        f_out.write(sections)
+        meta_bytes = build_metadata(args.app_name, args.app_version, args.install_dir, extra_meta)
         f_out.write(meta_bytes)
         # trailer: sizes to locate blob
-        trailer = TRAILER_STRUCT.pack(len(lz_data), len(meta_bytes), magic_offset)
+        trailer = TRAILER_STRUCT.pack(writer.blob_size, len(sections), len(meta_bytes), magic_offset)
         f_out.write(trailer)
 
     print(f"Wrote setup: {args.output}")
@@ -0,0 +1,117 @@
+# Container layout shared by pack.py and delta.py; mirrors src/interface/installer/format.h.
+
+import functools
+import lzma
+import shutil
+import struct
+import subprocess
+import zlib
+
+MAGIC = b"MIKOSETUP\0"
+# Blob of independently coded blocks, each described by a BIDX entry
+ALGO = b"BLKS"  # 4 bytes
+TRAILER_STRUCT = struct.Struct("<Q Q Q Q")  # (blob_size, sections_size, meta_size, magic_offset)
+SECTION_HEADER = struct.Struct("<4s I Q")  # (tag, reserved, size)
+HASH_ENTRY = struct.Struct("<Q 32s H")  # (size, sha256, path_len) followed by the path
+# (blob_offset, compressed_size, uncompressed_size, codec, flags)
+BLOCK_ENTRY = struct.Struct("<Q Q Q 4s I")
+# Block flag: the block begins on a TAR header, so it and the blocks up to the next such
+# block can be decoded and unpacked without anything before them
+BLOCK_ENTRY_START = 1
+# Block flag: the block was padded so that its first entry's data (a stored block) or the
+# block itself (any other codec) starts on a PAGE_ALIGN boundary of the setup file
+BLOCK_ENTRY_ALIGNED = 2
+PAGE_ALIGN = 4096
+# (file_count, total_file_bytes, largest_file, archive_bytes, dir_count) followed by the dirs
+PLAN_HEADER = struct.Struct("<Q Q Q Q Q")
+
+LZMA_PRESET = 6
+DEFLATE_LEVEL = 9
+
+# Block codecs
+CODEC_STORE = b"STOR"  # already-compressed data, copied straight through
+CODEC_DEFLATE = b"DFLT"  # zlib stream: a fraction of LZMA's decode cost for a small size loss
+CODEC_LZMA = b"LZMA"  # .xz stream
+CODEC_DEFLATE_DICT = b"DFZD"  # zlib stream primed with the DICT section, for small text
+
+
+# Branch/call/jump converters run ahead of LZMA2 in an .xz filter chain. The chain is
+# recorded in the .xz block header, so liblzma's stream decoder undoes it without being told.
+BCJ_X86 = 0x04
+BCJ_ARM64 = 0x0A
+BCJ_RISCV = 0x0B
+BCJ_NAMES = {BCJ_X86: "x86", BCJ_ARM64: "arm64", BCJ_RISCV: "riscv"}
+
+
+@functools.lru_cache(maxsize=None)
+def bcj_encoder(filter_id: int):
+    """How to encode with a BCJ filter: "python" when the lzma module has it, "xz" when an
+    xz binary on PATH has it (ARM64 and RISC-V need a newer Python than most build agents
+    run), else None."""
+    try:
+        lzma.compress(b"", format=lzma.FORMAT_XZ, filters=[{"id": filter_id}, {"id": lzma.FILTER_LZMA2}])
+        return "python"
+    except (ValueError, lzma.LZMAError):
+        pass
+    xz = shutil.which("xz")
+    if xz:
+        probe = subprocess.run([xz, "--format=xz", f"--{BCJ_NAMES[filter_id]}", "--lzma2=preset=0", "-c"],
+                               input=b"probe", capture_output=True)
+        if probe.returncode == 0:
+            return "xz"
+    return None
+
+
+def compress_block(data, codec: bytes, bcj: int = 0, zdict: bytes = None) -> bytes:
+    if codec == CODEC_STORE:
+        return bytes(data)
+    if codec == CODEC_DEFLATE:
+        return zlib.compress(data, DEFLATE_LEVEL)
+    if codec == CODEC_DEFLATE_DICT:
+        c = zlib.compressobj(DEFLATE_LEVEL, zdict=zdict)
+        return c.compress(data) + c.flush()
+    encoder = bcj_encoder(bcj) if bcj else None
+    if encoder == "python":
+        filters = [{"id": bcj}, {"id": lzma.FILTER_LZMA2, "preset": LZMA_PRESET}]
+        return lzma.compress(data, format=lzma.FORMAT_XZ, filters=filters)
+    if encoder == "xz":
+        return subprocess.run([shutil.which("xz"), "--format=xz", "--check=crc64", "-T1", f"--{BCJ_NAMES[bcj]}",
+                               f"--lzma2=preset={LZMA_PRESET}", "-c"],
+                              input=bytes(data), capture_output=True, check=True).stdout
+    return lzma.compress(data, format=lzma.FORMAT_XZ, preset=LZMA_PRESET)
+
+
+def decompress_block(data, codec: bytes, zdict: bytes = None) -> bytes:
+    if codec == CODEC_STORE:
+        return bytes(data)
+    if codec == CODEC_DEFLATE:
+        return zlib.decompress(data)
+    if codec == CODEC_DEFLATE_DICT:
+        d = zlib.decompressobj(zdict=zdict)
+        return d.decompress(data) + d.flush()
+    if codec == CODEC_LZMA:
+        return lzma.decompress(data, format=lzma.FORMAT_XZ)
+    raise ValueError(f"unknown block codec {codec!r}")
+
+
+def parse_sections(raw: bytes):
+    sections = {}
+    p = 0
+    while p + SECTION_HEADER.size <= len(raw):
+        tag, _, size = SECTION_HEADER.unpack_from(raw, p)
+        p += SECTION_HEADER.size
+        sections[tag] = raw[p:p + size]
+        p += size
+    return sections
+
+
+def parse_blocks(table: bytes):
+    """BIDX section -> [(offset, compressed_size, uncompressed_size, codec)]."""
+    if len(table) < 8:
+        return []
+    (count,) = struct.unpack_from("<Q", table, 0)
+    out = []
+    for i in range(count):
+        offset, comp, raw, codec, _ = BLOCK_ENTRY.unpack_from(table, 8 + i * BLOCK_ENTRY.size)
+        out.append((offset, comp, raw, codec))
+    return out
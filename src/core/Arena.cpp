@@ -0,0 +1,56 @@
+#include "Arena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+Arena::Arena(size_t chunkSize) : chunkSize(std::max<size_t>(chunkSize, 256)) {}
+
+void* Arena::allocate(size_t size, size_t align) {
+    for (;;) {
+        if (current < chunks.size()) {
+            Chunk& c = chunks[current];
+            uintptr_t base = reinterpret_cast<uintptr_t>(c.data.get());
+            size_t offset = (size_t)(((base + used + align - 1) & ~(uintptr_t)(align - 1)) - base);
+            if (offset + size <= c.size) {
+                used = offset + size;
+                return c.data.get() + offset;
+            }
+            if (current + 1 < chunks.size()) {
+                // Reuse a chunk kept by reset()
+                ++current;
+                used = 0;
+                continue;
+            }
+        }
+        // Oversized requests get a chunk of their own, which reset() keeps like any other
+        size_t need = std::max(chunkSize, size + align);
+        chunks.push_back({std::unique_ptr<char[]>(new char[need]), need});
+        current = chunks.size() - 1;
+        used = 0;
+    }
+}
+
+std::string_view Arena::join(std::string_view a, std::string_view b, std::string_view c, std::string_view d) {
+    size_t len = a.size() + b.size() + c.size() + d.size();
+    char* out = static_cast<char*>(allocate(len + 1, 1));
+    char* p = out;
+    for (std::string_view part : {a, b, c, d}) {
+        if (part.empty()) continue;
+        memcpy(p, part.data(), part.size());
+        p += part.size();
+    }
+    *p = '\0';
+    return std::string_view(out, len);
+}
+
+void Arena::reset() {
+    current = 0;
+    used = 0;
+}
+
+size_t Arena::bytesReserved() const {
+    size_t total = 0;
+    for (const auto& c : chunks) total += c.size;
+    return total;
+}
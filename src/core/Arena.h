@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Bump allocator for short-lived, trivially destructible data such as per-entry path
+// strings. reset() rewinds to the first chunk without freeing anything, so once it has
+// grown to its working size an arena serves every later block without touching the heap.
+class Arena {
+public:
+    explicit Arena(size_t chunkSize = 64 * 1024);
+
+    void* allocate(size_t size, size_t align = alignof(std::max_align_t));
+    // NUL-terminated copy of the concatenated parts
+    std::string_view join(std::string_view a, std::string_view b = {}, std::string_view c = {},
+                          std::string_view d = {});
+    void reset();
+
+    size_t bytesReserved() const;
+    size_t chunkCount() const { return chunks.size(); }
+
+private:
+    struct Chunk {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+    size_t chunkSize;
+    std::vector<Chunk> chunks;
+    size_t current = 0; // chunk being filled
+    size_t used = 0;    // bytes used in it
+};
@@ -0,0 +1,136 @@
+#include "BufferPool.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+const size_t PAGE = 4096;
+const size_t HUGE_PAGE = 2 * 1024 * 1024;
+
+size_t roundUp(size_t n, size_t to) {
+    return (n + to - 1) / to * to;
+}
+
+} // namespace
+
+BufferPool::BufferPool(size_t bufferSize, size_t preallocate, bool hugePages)
+    : size(roundUp(bufferSize ? bufferSize : PAGE, PAGE)), huge(hugePages) {
+#ifdef __linux__
+    mappedLength = huge ? roundUp(size, HUGE_PAGE) : size;
+#else
+    // Large pages on Windows need SeLockMemoryPrivilege, which installers do not hold
+    huge = false;
+    mappedLength = size;
+#endif
+    for (size_t i = 0; i < preallocate; ++i) {
+        Mapping m = map();
+        if (!m.data) break;
+        all.push_back(m);
+        idle.push_back(m.data);
+    }
+}
+
+BufferPool::~BufferPool() {
+    for (const Mapping& m : all) {
+#ifdef _WIN32
+        VirtualFree(m.data, 0, MEM_RELEASE);
+#else
+        munmap(m.data, m.length);
+#endif
+    }
+}
+
+BufferPool::Mapping BufferPool::map() {
+#ifdef _WIN32
+    void* p = VirtualAlloc(nullptr, mappedLength, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    return {static_cast<uint8_t*>(p), mappedLength};
+#else
+    void* p = MAP_FAILED;
+#ifdef __linux__
+    if (huge) {
+        // Only succeeds with pages reserved in /proc/sys/vm/nr_hugepages
+        p = mmap(nullptr, mappedLength, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) ++hugeCount;
+    }
+#endif
+    if (p == MAP_FAILED) p = mmap(nullptr, mappedLength, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return {nullptr, 0};
+#ifdef MADV_HUGEPAGE
+    if (huge) madvise(p, mappedLength, MADV_HUGEPAGE);
+#endif
+    return {static_cast<uint8_t*>(p), mappedLength};
+#endif
+}
+
+BufferPool::Buffer BufferPool::acquire() {
+    Buffer b;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (idle.empty()) {
+        Mapping m = map();
+        if (!m.data) return b;
+        all.push_back(m);
+        idle.push_back(m.data);
+    }
+    b.pool = this;
+    b.ptr = idle.back();
+    b.len = size;
+    idle.pop_back();
+    if (++inUse > peak) peak = inUse;
+    return b;
+}
+
+void BufferPool::give(uint8_t* data) {
+    std::lock_guard<std::mutex> lock(mutex);
+    idle.push_back(data);
+    --inUse;
+}
+
+size_t BufferPool::buffersAllocated() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return all.size();
+}
+
+size_t BufferPool::peakInUse() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return peak;
+}
+
+size_t BufferPool::hugePageBuffers() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return hugeCount;
+}
+
+uint64_t BufferPool::bytesReserved() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return (uint64_t)all.size() * mappedLength;
+}
+
+BufferPool::Buffer::Buffer(Buffer&& other) noexcept : pool(other.pool), ptr(other.ptr), len(other.len) {
+    other.pool = nullptr;
+    other.ptr = nullptr;
+    other.len = 0;
+}
+
+BufferPool::Buffer& BufferPool::Buffer::operator=(Buffer&& other) noexcept {
+    if (this != &other) {
+        release();
+        pool = other.pool;
+        ptr = other.ptr;
+        len = other.len;
+        other.pool = nullptr;
+        other.ptr = nullptr;
+        other.len = 0;
+    }
+    return *this;
+}
+
+void BufferPool::Buffer::release() {
+    if (pool && ptr) pool->give(ptr);
+    pool = nullptr;
+    ptr = nullptr;
+    len = 0;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Recycled, page-aligned I/O buffers shared by the decode, hash and write stages. Buffers
+// are mapped straight from the OS (not the heap), kept when released and handed out again,
+// so a long extraction touches the same few megabytes instead of churning the allocator.
+// The pool grows when every buffer is out; it never blocks.
+class BufferPool {
+public:
+    // `hugePages` asks Linux for 2 MiB pages: explicit hugetlb pages when the system has
+    // them reserved, else transparent huge pages advised with madvise(); ignored elsewhere
+    explicit BufferPool(size_t bufferSize, size_t preallocate = 0, bool hugePages = false);
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Owns one buffer until destroyed, then returns it to the pool
+    class Buffer {
+    public:
+        Buffer() = default;
+        Buffer(Buffer&& other) noexcept;
+        Buffer& operator=(Buffer&& other) noexcept;
+        ~Buffer() { release(); }
+
+        uint8_t* data() const { return ptr; }
+        size_t size() const { return len; }
+        explicit operator bool() const { return ptr != nullptr; }
+        void release();
+
+    private:
+        friend class BufferPool;
+        BufferPool* pool = nullptr;
+        uint8_t* ptr = nullptr;
+        size_t len = 0;
+    };
+
+    // nullptr data() only when the OS refuses the memory
+    Buffer acquire();
+
+    size_t bufferSize() const { return size; }
+    // Buffers mapped so far, the most handed out at once, and how many got explicit huge pages
+    size_t buffersAllocated() const;
+    size_t peakInUse() const;
+    size_t hugePageBuffers() const;
+    uint64_t bytesReserved() const;
+
+private:
+    struct Mapping {
+        uint8_t* data;
+        size_t length;
+    };
+    Mapping map();
+    void give(uint8_t* data);
+
+    size_t size;
+    size_t mappedLength; // size rounded up to the page (or huge page) size
+    bool huge;
+    mutable std::mutex mutex;
+    std::vector<Mapping> all;
+    std::vector<uint8_t*> idle;
+    size_t inUse = 0;
+    size_t peak = 0;
+    size_t hugeCount = 0;
+};
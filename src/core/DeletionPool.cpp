@@ -0,0 +1,88 @@
+#include "DeletionPool.h"
+
+#include <algorithm>
+#include <map>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+bool removeFile(const fs::path& p) {
+    std::error_code ec;
+    if (fs::remove(p, ec) || !ec) return true; // removed, or already gone
+    // Read-only files refuse deletion on Windows; clear the attribute and retry once
+    std::error_code pec;
+    fs::permissions(p, fs::perms::owner_write, fs::perm_options::add, pec);
+    ec.clear();
+    return fs::remove(p, ec) || !ec;
+}
+
+} // namespace
+
+DeletionPool::DeletionPool(unsigned threads)
+    : threads(threads ? threads : std::max(2u, std::thread::hardware_concurrency())) {}
+
+template <typename Fn>
+void DeletionPool::parallelFor(size_t count, Fn fn) {
+    // Workers claim small index ranges so per-file cost differences even out
+    const size_t chunk = 64;
+    std::atomic<size_t> next{0};
+    auto work = [&]() {
+        for (;;) {
+            if (canceled.load(std::memory_order_relaxed)) return;
+            size_t begin = next.fetch_add(chunk);
+            if (begin >= count) return;
+            size_t end = std::min(count, begin + chunk);
+            for (size_t i = begin; i < end; ++i) fn(i);
+        }
+    };
+    size_t wanted = std::min<size_t>(threads, (count + chunk - 1) / chunk);
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < wanted; ++t) pool.emplace_back(work);
+    work();
+    for (auto& th : pool) th.join();
+}
+
+bool DeletionPool::run(const fs::path& root, const InstallManifest& manifest) {
+    const auto& files = manifest.files();
+    const auto& dirs = manifest.directories();
+    totalFiles = files.size();
+    totalBytes = manifest.totalBytes();
+    totalDirs = dirs.size();
+    filesDone = 0; bytesDone = 0; dirsDone = 0; failed = 0;
+
+    parallelFor(files.size(), [&](size_t i) {
+        if (removeFile(manifestPath(root, files[i].path))) {
+            bytesDone.fetch_add(files[i].size, std::memory_order_relaxed);
+        } else {
+            failed.fetch_add(1, std::memory_order_relaxed);
+        }
+        filesDone.fetch_add(1, std::memory_order_relaxed);
+    });
+    if (canceled) return false;
+
+    // Bottom-up: every directory of one depth is independent of the others at that depth
+    std::map<size_t, std::vector<size_t>, std::greater<size_t>> byDepth;
+    for (size_t i = 0; i < dirs.size(); ++i) {
+        byDepth[(size_t)std::count(dirs[i].begin(), dirs[i].end(), '/')].push_back(i);
+    }
+    for (const auto& level : byDepth) {
+        const auto& idx = level.second;
+        parallelFor(idx.size(), [&](size_t i) {
+            std::error_code ec;
+            fs::remove(manifestPath(root, dirs[idx[i]]), ec);
+            dirsDone.fetch_add(1, std::memory_order_relaxed);
+        });
+        if (canceled) return false;
+    }
+    return failed.load() == 0;
+}
+
+float DeletionPool::progress() const {
+    float f = totalFiles ? (float)filesDone.load() / (float)totalFiles : 1.0f;
+    float b = totalBytes ? (float)bytesDone.load() / (float)totalBytes : f;
+    float d = totalDirs ? (float)dirsDone.load() / (float)totalDirs : (f >= 1.0f ? 1.0f : 0.0f);
+    return 0.95f * (0.5f * f + 0.5f * b) + 0.05f * d;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "InstallManifest.h"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+
+// Removes the files listed in an InstallManifest with a pool of worker threads, then the
+// directories deepest-first. Counters are atomic so a UI thread can poll progress while
+// run() blocks on a worker.
+class DeletionPool {
+public:
+    explicit DeletionPool(unsigned threads = 0);
+
+    // Returns false if any listed file could not be removed. Directories that are not empty
+    // (user data left behind) are kept and do not count as failures.
+    bool run(const std::filesystem::path& root, const InstallManifest& manifest);
+    void cancel() { canceled = true; }
+
+    // 0..1 over the manifest's file count and bytes; the directory pass is the final 5%
+    float progress() const;
+    uint64_t filesDeleted() const { return filesDone.load(); }
+    uint64_t bytesDeleted() const { return bytesDone.load(); }
+    uint64_t dirsDeleted() const { return dirsDone.load(); }
+    uint64_t failures() const { return failed.load(); }
+    unsigned threadCount() const { return threads; }
+
+private:
+    template <typename Fn>
+    void parallelFor(size_t count, Fn fn);
+
+    unsigned threads;
+    uint64_t totalFiles = 0;
+    uint64_t totalBytes = 0;
+    uint64_t totalDirs = 0;
+    std::atomic<bool> canceled{false};
+    std::atomic<uint64_t> filesDone{0};
+    std::atomic<uint64_t> bytesDone{0};
+    std::atomic<uint64_t> dirsDone{0};
+    std::atomic<uint64_t> failed{0};
+};
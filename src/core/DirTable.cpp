@@ -0,0 +1,119 @@
+#include "DirTable.h"
+#include "Durability.h"
+
+#include <cerrno>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+DirTable::DirTable(const fs::path& root, ExtractIoStats& stats) : stats(stats) {
+    std::string prefix = root.u8string();
+    if (prefix.empty() || (prefix.back() != '/' && prefix.back() != '\\')) prefix.push_back('/');
+    std::error_code ec;
+    fs::create_directories(root, ec);
+    Dir rootDir;
+    rootDir.rel = names.join("");
+    rootDir.path = names.join(prefix);
+    dirs.push_back(rootDir);
+    index.emplace(dirs.back().rel, &dirs.back());
+}
+
+const DirTable::Dir* DirTable::intern(std::string_view rel) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return internLocked(rel);
+}
+
+size_t DirTable::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return dirs.size();
+}
+
+bool DirTable::syncAll() {
+    std::lock_guard<std::mutex> lock(mutex);
+    bool ok = true;
+    for (const Dir& dir : dirs) {
+        stats.syncs.fetch_add(1, std::memory_order_relaxed);
+        ok = syncDirectory(fs::u8path(dir.path.begin(), dir.path.end())) && ok;
+    }
+    return ok;
+}
+
+const DirTable::Dir* DirTable::internLocked(std::string_view rel) {
+    auto it = index.find(rel);
+    if (it != index.end()) return it->second;
+
+    size_t slash = rel.find_last_of('/');
+    const Dir* parent = internLocked(slash == std::string_view::npos ? std::string_view() : rel.substr(0, slash));
+    if (!parent) return nullptr;
+    std::string_view name = slash == std::string_view::npos ? rel : rel.substr(slash + 1);
+
+    Dir dir;
+    dir.rel = names.join(rel);
+    dir.path = names.join(parent->path, name, "/");
+    dir.id = (uint32_t)dirs.size();
+    stats.mkdirs.fetch_add(1, std::memory_order_relaxed);
+#ifdef _WIN32
+    std::error_code ec;
+    fs::path native = fs::u8path(dir.path.begin(), dir.path.end());
+    fs::create_directory(native, ec);
+    if (ec && !fs::is_directory(native, ec)) return nullptr;
+#else
+    // Existing directories (updates, repairs) are fine; anything else is not
+    if (mkdir(dir.path.data(), 0777) != 0 && errno != EEXIST) return nullptr;
+#endif
+    dirs.push_back(dir);
+    index.emplace(dirs.back().rel, &dirs.back());
+    return &dirs.back();
+}
+
+DirTable::Handles::Handles(ExtractIoStats& stats, size_t count) : slots(count ? count : 1), stats(stats) {}
+
+DirTable::Handles::~Handles() {
+    closeAll();
+}
+
+int DirTable::Handles::get(const Dir& dir) {
+#ifdef _WIN32
+    (void)dir;
+    return -1;
+#else
+    Slot& slot = slots[dir.id % slots.size()];
+    if (slot.id == dir.id) return slot.fd;
+    if (slot.fd >= 0) {
+        if (deferred) evicted.push_back(slot.fd);
+        else close(slot.fd);
+    }
+    slot.fd = ::open(dir.path.data(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    slot.id = slot.fd >= 0 ? dir.id : UINT32_MAX;
+    stats.dirOpens.fetch_add(1, std::memory_order_relaxed);
+    return slot.fd;
+#endif
+}
+
+void DirTable::Handles::closeAll() {
+    endGeneration();
+    endGeneration();
+    for (auto& slot : slots) {
+        if (slot.fd >= 0) close(slot.fd);
+        slot = Slot();
+    }
+}
+
+void DirTable::Handles::endGeneration() {
+    for (int fd : older) close(fd);
+    older.swap(evicted);
+    evicted.clear();
+}
+
+void DirTable::Handles::close(int fd) {
+#ifdef _WIN32
+    (void)fd;
+#else
+    ::close(fd);
+    stats.closes.fetch_add(1, std::memory_order_relaxed);
+#endif
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "Arena.h"
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Filesystem operations made by one extraction, counted for the benchmarks. With the
+// io_uring writer, opens, writes and closes are ring operations, not system calls; `submits`
+// counts the io_uring_enter() calls that submitted and reaped them.
+struct ExtractIoStats {
+    std::atomic<uint64_t> mkdirs{0};
+    std::atomic<uint64_t> dirOpens{0};
+    std::atomic<uint64_t> fileOpens{0};
+    std::atomic<uint64_t> writes{0};
+    std::atomic<uint64_t> closes{0};
+    std::atomic<uint64_t> renames{0};
+    std::atomic<uint64_t> submits{0};
+    std::atomic<uint64_t> syncs{0};
+    std::atomic<uint64_t> copies{0};      // file-to-file copy and clone calls
+    std::atomic<uint64_t> copiedBytes{0}; // bytes that went through them instead of memory
+
+    uint64_t total() const {
+        return mkdirs.load() + dirOpens.load() + fileOpens.load() + writes.load() + closes.load() + renames.load() +
+               syncs.load() + copies.load();
+    }
+    void clear() {
+        mkdirs = 0; dirOpens = 0; fileOpens = 0; writes = 0; closes = 0; renames = 0; submits = 0; syncs = 0;
+        copies = 0; copiedBytes = 0;
+    }
+};
+
+// Interned table of the directories an extraction writes into. Each one is created exactly
+// once, with a single mkdir after its parent (no stat walk up the path), and on POSIX every
+// thread keeps open handles to recent ones so files are opened with openat() on their bare
+// name instead of the kernel resolving the full path again.
+class DirTable {
+public:
+    struct Dir {
+        std::string_view rel;  // relative to the root, "" for the root itself
+        std::string_view path; // UTF-8 under the root with a trailing '/', NUL-terminated
+        uint32_t id = 0;
+    };
+
+    DirTable(const std::filesystem::path& root, ExtractIoStats& stats);
+
+    // The directory `rel`, created together with any missing parents the first time it is
+    // asked for; nullptr when that fails. Thread-safe; returned pointers stay valid.
+    const Dir* intern(std::string_view rel);
+    size_t size() const;
+    // Flushes every directory in the table, so the names in them survive a crash; false
+    // when any flush failed
+    bool syncAll();
+
+    // One thread's cache of open directory handles, direct-mapped by Dir::id
+    class Handles {
+    public:
+        explicit Handles(ExtractIoStats& stats, size_t slots = 64);
+        ~Handles();
+        Handles(const Handles&) = delete;
+        Handles& operator=(const Handles&) = delete;
+
+        // Handle for openat() and friends; -1 when it cannot be opened, and always on Windows
+        int get(const Dir& dir);
+        void closeAll();
+        // Asynchronous writers may still use a handle after it leaves the cache: with closes
+        // deferred, an evicted handle stays open until the second endGeneration() after it
+        void deferCloses(bool defer) { deferred = defer; }
+        void endGeneration();
+
+    private:
+        void close(int fd);
+
+        struct Slot {
+            uint32_t id = UINT32_MAX;
+            int fd = -1;
+        };
+        std::vector<Slot> slots;
+        ExtractIoStats& stats;
+        bool deferred = false;
+        std::vector<int> evicted; // this generation's, then the previous one's
+        std::vector<int> older;
+    };
+
+private:
+    const Dir* internLocked(std::string_view rel);
+
+    ExtractIoStats& stats;
+    mutable std::mutex mutex;
+    Arena names;
+    std::deque<Dir> dirs; // stable addresses
+    std::unordered_map<std::string_view, const Dir*> index;
+};
@@ -0,0 +1,98 @@
+#include "Durability.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+const char* durabilityName(Durability d) {
+    switch (d) {
+    case Durability::None: return "none";
+    case Durability::PerFile: return "file";
+    case Durability::SyncAtEnd: return "end";
+    case Durability::DirectoryBarriers: return "barriers";
+    }
+    return "?";
+}
+
+bool parseDurability(const std::string& name, Durability& out) {
+    for (auto d : {Durability::None, Durability::PerFile, Durability::SyncAtEnd, Durability::DirectoryBarriers}) {
+        if (name == durabilityName(d)) {
+            out = d;
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifdef _WIN32
+
+namespace {
+
+bool flushPath(const fs::path& path, DWORD flags) {
+    HANDLE h = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                           nullptr, OPEN_EXISTING, flags, nullptr);
+    if (h == INVALID_HANDLE_VALUE) return false;
+    bool ok = FlushFileBuffers(h) != 0;
+    CloseHandle(h);
+    return ok;
+}
+
+} // namespace
+
+bool syncFile(const fs::path& file) {
+    return flushPath(file, FILE_ATTRIBUTE_NORMAL);
+}
+
+bool syncDirectory(const fs::path& dir) {
+    // Directories only open with backup semantics
+    return flushPath(dir, FILE_FLAG_BACKUP_SEMANTICS);
+}
+
+bool syncFilesystem(const fs::path& path) {
+    std::wstring root = fs::absolute(path).root_name().wstring(); // "C:"
+    if (root.size() != 2 || root[1] != L':') return false;
+    return flushPath(L"\\\\.\\" + root, 0);
+}
+
+#else
+
+namespace {
+
+bool syncPath(const fs::path& path, int flags) {
+    int fd = ::open(path.c_str(), flags | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+} // namespace
+
+bool syncFile(const fs::path& file) {
+    return syncPath(file, O_WRONLY);
+}
+
+bool syncDirectory(const fs::path& dir) {
+    return syncPath(dir, O_RDONLY | O_DIRECTORY);
+}
+
+bool syncFilesystem(const fs::path& path) {
+#ifdef __linux__
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = ::syncfs(fd) == 0;
+    ::close(fd);
+    return ok;
+#else
+    (void)path;
+    ::sync();
+    return true;
+#endif
+}
+
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+#include <filesystem>
+#include <string>
+
+// When an install's data is forced to stable storage
+enum class Durability {
+    None,              // left to the OS: fastest, for image builds; a crash can leave files short
+    PerFile,           // each file flushed as it is closed
+    SyncAtEnd,         // one flush of the whole filesystem after the last file
+    DirectoryBarriers, // PerFile, then every directory flushed before the staged tree is
+                       // swapped in and the swap itself flushed: a crash leaves either the
+                       // old install or the complete new one
+};
+
+const char* durabilityName(Durability d);
+// "none", "file", "end" or "barriers"
+bool parseDurability(const std::string& name, Durability& out);
+
+// Each returns false when the OS refused
+bool syncFile(const std::filesystem::path& file);
+bool syncDirectory(const std::filesystem::path& dir);
+// Flushes the filesystem holding `path`: syncfs() on Linux, sync() on other POSIX systems,
+// the volume on Windows, which needs administrator rights
+bool syncFilesystem(const std::filesystem::path& path);
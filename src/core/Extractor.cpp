@@ -0,0 +1,354 @@
+#include "Extractor.h"
+#include "WorkStealingQueue.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Decoder-to-parser ring: 2 MiB in flight keeps both stages busy without much memory
+const size_t PIPELINE_SLOTS = 8;
+const size_t PIPELINE_SLOT_SIZE = 256 * 1024;
+
+} // namespace
+
+bool isSafeEntryPath(const std::string& path) {
+    if (path.empty() || path[0] == '/' || path[0] == '\\' || path.find(':') != std::string::npos) return false;
+    size_t start = 0;
+    while (start <= path.size()) {
+        size_t end = path.find_first_of("/\\", start);
+        if (end == std::string::npos) end = path.size();
+        if (path.compare(start, end - start, "..") == 0 && end - start == 2) return false;
+        start = end + 1;
+    }
+    return true;
+}
+
+Extractor::Extractor(const PayloadReader& payload, const fs::path& outRoot) : payload(payload), root(outRoot) {}
+
+float Extractor::progress() const {
+    if (archiveTotal) return std::min(1.0f, (float)decoded.load() / (float)archiveTotal);
+    uint64_t total = payload.blobSize();
+    return total ? std::min(1.0f, (float)consumed.load() / (float)total) : 1.0f;
+}
+
+bool Extractor::fail(const std::string& message) {
+    std::lock_guard<std::mutex> lock(errorMutex);
+    if (lastError.empty()) lastError = message;
+    aborted = true;
+    return false;
+}
+
+bool Extractor::beginEntry(Lane& lane, const TarEntry& entry) {
+    if (aborted.load(std::memory_order_relaxed)) return false;
+    if (opts.cancel && opts.cancel->load()) return fail("canceled");
+    if (!isSafeEntryPath(entry.path)) return fail("unsafe path in payload: " + entry.path);
+    lane.writing = false;
+    lane.arena.reset(); // the previous entry's paths are dead once it has ended
+    bool wanted = !opts.only || opts.only->count(entry.path);
+    if (!wanted) return true;
+
+    std::string_view path(entry.path);
+    if (entry.isDirectory()) {
+        if (!dirTable->intern(path)) return fail("cannot create " + entry.path);
+        lane.record->dirs.push_back(lane.record->names.join(path));
+        return true;
+    }
+    if (!entry.isFile()) return true; // links and devices are not part of installs
+
+    size_t slash = path.find_last_of('/');
+    std::string_view parent = slash == std::string_view::npos ? std::string_view() : path.substr(0, slash);
+    if (!lane.dir || lane.dir->rel != parent) {
+        lane.dir = dirTable->intern(parent);
+        if (!lane.dir) return fail("cannot create " + std::string(parent));
+        lane.dirFd = lane.handles.get(*lane.dir);
+    }
+    lane.name = lane.arena.join(slash == std::string_view::npos ? path : path.substr(slash + 1));
+    lane.finalPath = lane.arena.join(lane.dir->path, lane.name);
+    if (opts.replaceExisting) {
+        lane.outName = lane.arena.join(lane.name, ".miko-new");
+        lane.outPath = lane.arena.join(lane.finalPath, ".miko-new");
+    } else {
+        lane.outName = lane.name;
+        lane.outPath = lane.finalPath;
+    }
+    if (lane.batcher && entry.size <= lane.batcher->maxFileSize()) {
+        if (!lane.batcher->add(lane.dirFd, lane.name, lane.finalPath, (size_t)entry.size)) {
+            return fail("write failed: " + lane.batcher->error());
+        }
+        lane.batching = true;
+        lane.record->files.emplace_back(lane.record->names.join(path), entry.size);
+        lane.writing = true;
+        return true;
+    }
+    OutputFile::Mode mode = OutputFile::Mode::Buffered;
+    if (entry.size >= opts.largeFileThreshold) {
+        mode = opts.unbufferedLargeFiles ? OutputFile::Mode::Unbuffered : OutputFile::Mode::Aligned;
+    }
+    lane.out.setBuffer(lane.outBuffer.data(), lane.outBuffer.size());
+    if (!lane.out.open(lane.dirFd, lane.outName.data(), lane.outPath.data(), mode)) {
+        return fail("cannot create " + std::string(lane.finalPath));
+    }
+    if (opts.preallocate) lane.out.preallocate(entry.size);
+    lane.record->files.emplace_back(lane.record->names.join(path), entry.size);
+    lane.writing = true;
+    return true;
+}
+
+bool Extractor::writeData(Lane& lane, const uint8_t* data, size_t len) {
+    if (!lane.writing) return true;
+    if (lane.batching ? !lane.batcher->append(data, len) : !lane.out.write(data, len)) {
+        return fail("write failed: " + std::string(lane.finalPath));
+    }
+    written.fetch_add(len, std::memory_order_relaxed);
+    return true;
+}
+
+bool Extractor::endEntry(Lane& lane) {
+    if (!lane.writing) return true;
+    lane.writing = false;
+    if (lane.batching) {
+        // Lands with its batch; failures surface when the batch is waited for
+        lane.batching = false;
+        files.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    if (syncEachFile() && !lane.out.sync()) return fail("cannot flush " + std::string(lane.finalPath));
+    if (!lane.out.close()) return fail("write failed: " + std::string(lane.finalPath));
+    if (lane.outName != lane.name) {
+        if (!replaceFile(lane.dirFd, lane.outName.data(), lane.name.data(), lane.outPath.data(),
+                         lane.finalPath.data(), io)) {
+            removeFile(lane.dirFd, lane.outName.data(), lane.outPath.data());
+            return fail("cannot replace " + std::string(lane.finalPath));
+        }
+    }
+    files.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void Extractor::abandon(Lane& lane) {
+    if (!lane.writing) return;
+    // Aborted mid-file: do not leave a truncated file behind under its real name
+    if (lane.batching) {
+        lane.batcher->dropLast();
+        lane.batching = false;
+    } else {
+        lane.out.discard();
+        removeFile(lane.dirFd, lane.outName.data(), lane.outPath.data());
+    }
+    lane.writing = false;
+}
+
+bool Extractor::syncEachFile() const {
+    return opts.durability == Durability::PerFile || opts.durability == Durability::DirectoryBarriers;
+}
+
+bool Extractor::makeDurable(const std::vector<RunRecord>& records) {
+    if (opts.durability == Durability::SyncAtEnd) {
+        io.syncs.fetch_add(1, std::memory_order_relaxed);
+        if (syncFilesystem(root)) return true;
+        // Windows without administrator rights cannot flush the volume: flush each file
+        bool ok = true;
+        for (const auto& record : records) {
+            for (const auto& f : record.files) {
+                io.syncs.fetch_add(1, std::memory_order_relaxed);
+                ok = syncFile(manifestPath(root, std::string(f.first))) && ok;
+            }
+        }
+        return ok || fail("cannot flush the installed files");
+    }
+    if (opts.durability == Durability::DirectoryBarriers && !dirTable->syncAll()) {
+        return fail("cannot flush the installed directories");
+    }
+    return true;
+}
+
+void Extractor::startLane(Lane& lane) {
+    lane.outBuffer = buffers->acquire();
+    if (opts.copyStored) lane.source.open(payload.path());
+    if (opts.replaceExisting) return; // renames stay in order with their writes
+    lane.writer = WriteBackend::create(opts.writer, io, opts.writeDepth, syncEachFile());
+    if (lane.writer) {
+        lane.batcher = std::make_unique<SmallFileBatcher>(*lane.writer, *buffers, lane.handles, opts.writeDepth);
+    }
+}
+
+bool Extractor::unpack(Lane& lane, const Decode& decode, bool wholeArchive, bool pipelined) {
+    TarParser tar;
+    tar.onEntry = [&](const TarEntry& e) { return beginEntry(lane, e); };
+    tar.onData = [&](const uint8_t* d, size_t n) { return writeData(lane, d, n); };
+    tar.onEntryEnd = [&]() { return endEntry(lane); };
+    auto feed = [&](const uint8_t* d, size_t n) {
+        decoded.fetch_add(n, std::memory_order_relaxed);
+        if (opts.progress) opts.progress->store(progress(), std::memory_order_relaxed);
+        return tar.feed(d, n);
+    };
+    // Bodies in stored blocks: copied file to file, or skipped when not wanted; everything
+    // else is read up to where the next body starts
+    PayloadReader::StoredSink stored = [&](uint64_t offset, uint64_t len, uint64_t& taken, uint64_t& readAhead) {
+        uint64_t body = std::min(tar.dataRemaining(), len);
+        if (body && (!lane.writing || (!lane.batching && lane.source.isOpen() && lane.out.canCopy()))) {
+            if (lane.writing) {
+                if (!lane.out.copyFrom(lane.source, offset, body)) {
+                    return fail("write failed: " + std::string(lane.finalPath));
+                }
+                written.fetch_add(body, std::memory_order_relaxed);
+            }
+            decoded.fetch_add(body, std::memory_order_relaxed);
+            if (opts.progress) opts.progress->store(progress(), std::memory_order_relaxed);
+            taken = body;
+            return tar.skipData(body);
+        }
+        readAhead = tar.bytesBeforeData();
+        return true;
+    };
+    const PayloadReader::StoredSink* offer = lane.source.isOpen() || opts.only ? &stored : nullptr;
+
+    bool ok = true;
+    if (pipelined) {
+        // Decoder thread fills whole slots; this thread parses and writes them
+        SpscRing ring(PIPELINE_SLOTS, PIPELINE_SLOT_SIZE);
+        std::thread decoder([&] {
+            uint8_t* slot = nullptr;
+            size_t fill = 0;
+            ok = decode([&](const uint8_t* d, size_t n) {
+                while (n) {
+                    if (!slot && !(slot = ring.acquire())) return false; // parser gave up
+                    size_t take = std::min(n, ring.slotSize() - fill);
+                    memcpy(slot + fill, d, take);
+                    fill += take; d += take; n -= take;
+                    if (fill == ring.slotSize()) {
+                        ring.publish(fill);
+                        slot = nullptr;
+                        fill = 0;
+                    }
+                }
+                return true;
+            }, nullptr);
+            if (slot && fill) ring.publish(fill);
+            ring.close();
+        });
+        const uint8_t* d;
+        size_t n;
+        while (ring.peek(d, n)) {
+            bool fed = feed(d, n);
+            ring.release();
+            if (!fed) {
+                ring.cancel();
+                break;
+            }
+        }
+        decoder.join();
+        ringStats = ring.stats();
+    } else {
+        ok = decode(feed, offer);
+    }
+    abandon(lane);
+    if (lane.batcher && !lane.batcher->finish()) return fail("write failed: " + lane.batcher->error());
+    if (!ok || tar.failed()) return fail(tar.failed() ? "corrupt archive" : "payload decode failed");
+    // A run must end between entries; the next run's first header does not continue it
+    if (!wholeArchive && !tar.betweenEntries()) return fail("corrupt archive");
+    return true;
+}
+
+bool Extractor::run(const ExtractOptions& options) {
+    opts = options;
+    consumed = 0; decoded = 0; written = 0; files = 0;
+    aborted = false;
+    lastError.clear();
+    io.clear();
+    runs = 0;
+    stolen = 0;
+    pipelinedRun = false;
+    ringStats = RingStats();
+    dirTable = std::make_unique<DirTable>(root, io);
+
+    InstallPlan plan;
+    archiveTotal = 0;
+    uint64_t largestFile = 1 << 20;
+    std::vector<PayloadBlock> index;
+    if (payload.plan(plan)) {
+        archiveTotal = plan.archiveBytes;
+        created.reserve((size_t)plan.fileCount, plan.directories.size());
+        largestFile = plan.largestFile;
+        if (!opts.only) {
+            // The whole tree up front, instead of a parent check per file while decoding
+            for (const auto& dir : plan.directories) {
+                if (isSafeEntryPath(dir)) dirTable->intern(dir);
+            }
+        }
+        index = std::move(plan.blocks);
+    } else {
+        index = payload.blocks();
+    }
+
+    buffers = opts.buffers;
+    if (!buffers) {
+        // Sized for the largest file, capped, so small installs do not pay for big buffers
+        size_t size = (size_t)std::min<uint64_t>(std::max<uint64_t>(largestFile, 256 * 1024), 1 << 20);
+        if (!ownBuffers || ownBuffers->bufferSize() != size) ownBuffers = std::make_unique<BufferPool>(size);
+        buffers = ownBuffers.get();
+    }
+
+    std::vector<BlockRun> blockRuns;
+    if (payload.algorithm() == std::string(MIKO_ALGO_BLOCKS, 4)) blockRuns = splitBlockRuns(index);
+    runs = std::max<size_t>(1, blockRuns.size());
+    std::vector<RunRecord> records(runs);
+    unsigned threads = opts.threads ? opts.threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = (unsigned)std::min<size_t>(threads, blockRuns.size());
+
+    bool ok = true;
+    if (threads <= 1) {
+        // Stored blocks give the decoder thread nothing to overlap, and can only be copied
+        // file to file when this thread reads them itself
+        uint64_t storedBytes = 0, rawBytes = 0;
+        for (const auto& b : index) {
+            if (memcmp(b.codec, MIKO_CODEC_STORE, 4) == 0) storedBytes += b.rawSize;
+            rawBytes += b.rawSize;
+        }
+        bool pipelined = opts.pipeline && !(opts.copyStored && storedBytes * 2 > rawBytes);
+        pipelinedRun = pipelined;
+        Lane lane(io);
+        startLane(lane);
+        lane.record = &records[0];
+        ok = unpack(lane, [&](const PayloadReader::Sink& sink, const PayloadReader::StoredSink* stored) {
+            return payload.decode(sink, &consumed, buffers, stored);
+        }, true, pipelined);
+    } else {
+        // Largest runs first, so a big runtime does not start last and finish alone
+        std::vector<size_t> order(blockRuns.size());
+        for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+        std::stable_sort(order.begin(), order.end(),
+                         [&](size_t a, size_t b) { return blockRuns[a].rawSize > blockRuns[b].rawSize; });
+        WorkStealingQueue queue(threads);
+        queue.deal(order);
+        auto work = [&](unsigned worker) {
+            Lane lane(io);
+            startLane(lane);
+            size_t r;
+            while (!aborted.load(std::memory_order_relaxed) && queue.take(worker, r)) {
+                const BlockRun& run = blockRuns[r];
+                lane.record = &records[r];
+                unpack(lane, [&](const PayloadReader::Sink& sink, const PayloadReader::StoredSink* stored) {
+                    return payload.decodeBlocks(index.data() + run.first, run.count, sink, &consumed, buffers, stored);
+                }, r + 1 == blockRuns.size());
+            }
+        };
+        std::vector<std::thread> pool;
+        for (unsigned t = 1; t < threads; ++t) pool.emplace_back(work, t);
+        work(0);
+        for (auto& th : pool) th.join();
+        stolen = queue.steals();
+        ok = !aborted.load();
+    }
+    ok = ok && makeDurable(records);
+
+    for (const auto& record : records) {
+        for (const auto& dir : record.dirs) created.addDirectory(dir);
+        for (const auto& f : record.files) created.addFile(f.first, f.second);
+    }
+    return ok;
+}
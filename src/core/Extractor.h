@@ -0,0 +1,157 @@
+#pragma once
+#include "Arena.h"
+#include "BufferPool.h"
+#include "DirTable.h"
+#include "Durability.h"
+#include "InstallManifest.h"
+#include "OutputFile.h"
+#include "Payload.h"
+#include "SpscRing.h"
+#include "TarStream.h"
+#include "WriteBackend.h"
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+struct ExtractOptions {
+    // When set, only these TAR paths are written; everything else is decoded and skipped
+    const std::unordered_set<std::string>* only = nullptr;
+    // Write each file under a temporary name and rename it over the existing one
+    bool replaceExisting = false;
+    const std::atomic<bool>* cancel = nullptr;
+    // Updated with progress() as decoding advances, for UIs polling a plain atomic
+    std::atomic<float>* progress = nullptr;
+    // Workers unpacking independent block runs; 0 = one per core
+    unsigned threads = 0;
+    // With a single worker, decode on a second thread that hands data to the TAR parser
+    // and file writes through an SpscRing
+    bool pipeline = true;
+    // Decode and write buffers; a private pool sized for the payload when null
+    BufferPool* buffers = nullptr;
+    // How small files are written; larger ones, and all of them with replaceExisting, are
+    // written directly by the extracting thread
+    WriteBackendKind writer = WriteBackendKind::Auto;
+    // Small files per batch handed to the write backend
+    size_t writeDepth = 64;
+    // Reserve each directly written file's full size before writing it
+    bool preallocate = true;
+    // Files this large are written in whole, aligned buffers (see OutputFile::Mode), and
+    // with unbufferedLargeFiles past the page cache, which a multi-gigabyte runtime would
+    // otherwise flood
+    uint64_t largeFileThreshold = 8 << 20;
+    bool unbufferedLargeFiles = false;
+    // What run() forces to stable storage before it returns (see Durability)
+    Durability durability = Durability::None;
+    // Copy the bodies of entries the payload stores uncompressed straight from the setup
+    // file into their outputs (see OutputFile::copyFrom()) instead of reading them in;
+    // unwanted ones are skipped without being read. Not with the single-thread pipeline,
+    // which run() then only uses when most of the payload is compressed.
+    bool copyStored = true;
+};
+
+// Streams a payload's TAR into a directory tree, recording what it creates. Blocked
+// payloads are unpacked run by run (see splitBlockRuns()) on a work-stealing pool; the
+// manifest still lists entries in TAR order.
+class Extractor {
+public:
+    Extractor(const PayloadReader& payload, const std::filesystem::path& outRoot);
+
+    bool run(const ExtractOptions& options = ExtractOptions());
+
+    const InstallManifest& manifest() const { return created; }
+    // 0..1 by TAR bytes decoded when the payload has a PLAN, else by compressed bytes
+    // consumed; safe to poll from another thread
+    float progress() const;
+    uint64_t bytesWritten() const { return written.load(); }
+    uint64_t filesWritten() const { return files.load(); }
+    const std::string& error() const { return lastError; }
+    // Runs the last run() split the payload into, and how many of them changed workers
+    size_t runCount() const { return runs; }
+    uint64_t runsStolen() const { return stolen; }
+    // Whether the last run() decoded on a second thread through the ring; it declines
+    // ExtractOptions::pipeline for mostly stored payloads when copying them
+    bool pipelined() const { return pipelinedRun; }
+    // Decoder-to-parser ring counters of the last run(); zero when it was not pipelined
+    const RingStats& pipelineStats() const { return ringStats; }
+    // Filesystem calls the last run() made
+    const ExtractIoStats& ioStats() const { return io; }
+
+private:
+    // One thread's output state: the file being written and what its current run created.
+    // The entry's paths live in `arena`, rewound at each new entry, and the names kept for
+    // the manifest in the run's own arena, so on POSIX the decode-and-write loop itself
+    // makes no per-entry heap allocations. Files are opened relative to their parent's
+    // handle; consecutive files in one directory reuse it without a lookup.
+    struct RunRecord;
+    struct Lane {
+        explicit Lane(ExtractIoStats& io) : out(io), handles(io) {}
+        OutputFile out;
+        DirTable::Handles handles;
+        std::unique_ptr<WriteBackend> writer;      // null when writing directly
+        std::unique_ptr<SmallFileBatcher> batcher; // destroyed first: it drains into writer
+        bool batching = false;                     // the current file goes to batcher
+        Arena arena;
+        const DirTable::Dir* dir = nullptr; // parent of the current file
+        int dirFd = -1;
+        std::string_view name;    // bare names in `dir`, NUL-terminated, in arena
+        std::string_view outName;
+        std::string_view outPath; // full paths, for messages and when there is no handle
+        std::string_view finalPath;
+        bool writing = false;
+        BufferPool::Buffer outBuffer; // gathers small files into page-aligned writes
+        SourceFile source;            // the setup file, when stored bodies are copied
+        RunRecord* record = nullptr;
+    };
+    // Entries one run created, in TAR order; merged into the manifest after all runs
+    struct RunRecord {
+        Arena names{16 * 1024};
+        std::vector<std::pair<std::string_view, uint64_t>> files;
+        std::vector<std::string_view> dirs;
+    };
+
+    bool beginEntry(Lane& lane, const TarEntry& entry);
+    bool writeData(Lane& lane, const uint8_t* data, size_t len);
+    bool endEntry(Lane& lane);
+    using Decode = std::function<bool(const PayloadReader::Sink&, const PayloadReader::StoredSink*)>;
+    // Feeds decoded bytes of one run (or the whole blob) through a fresh TAR parser
+    bool unpack(Lane& lane, const Decode& decode, bool wholeArchive, bool pipelined = false);
+    void abandon(Lane& lane);
+    void startLane(Lane& lane);
+    bool syncEachFile() const;
+    // The end-of-run part of opts.durability
+    bool makeDurable(const std::vector<RunRecord>& records);
+    bool fail(const std::string& message);
+
+    const PayloadReader& payload;
+    std::filesystem::path root;
+    ExtractOptions opts;
+    InstallManifest created;
+    std::atomic<uint64_t> consumed{0};
+    std::atomic<uint64_t> decoded{0};
+    uint64_t archiveTotal = 0; // from the PLAN section, 0 when unknown
+    std::unique_ptr<BufferPool> ownBuffers;
+    BufferPool* buffers = nullptr; // opts.buffers or ownBuffers
+    ExtractIoStats io;
+    std::unique_ptr<DirTable> dirTable; // directories created so far, shared by all workers
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> files{0};
+    // Set by the first worker to fail, so the others stop at their next entry
+    std::atomic<bool> aborted{false};
+    std::mutex errorMutex;
+    std::string lastError;
+    size_t runs = 0;
+    uint64_t stolen = 0;
+    bool pipelinedRun = false;
+    RingStats ringStats;
+};
+
+// Rejects absolute paths and ".." components so a payload cannot write outside the root
+bool isSafeEntryPath(const std::string& path);
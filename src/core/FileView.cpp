@@ -0,0 +1,70 @@
+#include "FileView.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool FileView::map(const std::filesystem::path& file, uint64_t offset, uint64_t len) {
+    unmap();
+    if (!len || len > SIZE_MAX) return false;
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    uint64_t start = offset - offset % info.dwAllocationGranularity;
+    HANDLE f = CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (f == INVALID_HANDLE_VALUE) return false;
+    HANDLE section = CreateFileMappingW(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(f);
+    if (!section) return false;
+    // The view keeps the section alive after its handle is closed
+    mapped = (size_t)(offset - start + len);
+    base = MapViewOfFile(section, FILE_MAP_READ, (DWORD)(start >> 32), (DWORD)start, mapped);
+    CloseHandle(section);
+    if (!base) return false;
+    ptr = static_cast<const uint8_t*>(base) + (offset - start);
+    length = len;
+    return true;
+}
+
+void FileView::unmap() {
+    if (base) UnmapViewOfFile(base);
+    base = nullptr;
+    ptr = nullptr;
+    length = 0;
+}
+
+#else
+
+bool FileView::map(const std::filesystem::path& file, uint64_t offset, uint64_t len) {
+    unmap();
+    if (!len || len > SIZE_MAX) return false;
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t start = offset - offset % page;
+    int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    mapped = (size_t)(offset - start + len);
+    void* p = mmap(nullptr, mapped, PROT_READ, MAP_PRIVATE, fd, (off_t)start);
+    ::close(fd);
+    if (p == MAP_FAILED) return false;
+    // Read ahead aggressively and drop pages behind: each byte is used once
+    madvise(p, mapped, MADV_SEQUENTIAL);
+    base = p;
+    ptr = static_cast<const uint8_t*>(base) + (offset - start);
+    length = len;
+    return true;
+}
+
+void FileView::unmap() {
+    if (base) munmap(base, mapped);
+    base = nullptr;
+    ptr = nullptr;
+    length = 0;
+}
+
+#endif
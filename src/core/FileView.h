@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+// Read-only mapping of part of a file, so its bytes are used in place instead of being
+// read into a buffer. The mapping starts at the allocation boundary below `offset`; a
+// page-aligned offset therefore comes out at a page-aligned address, which unbuffered
+// writes can take straight from the page cache.
+class FileView {
+public:
+    FileView() = default;
+    ~FileView() { unmap(); }
+    FileView(const FileView&) = delete;
+    FileView& operator=(const FileView&) = delete;
+
+    // Replaces any previous mapping; false when the range cannot be mapped
+    bool map(const std::filesystem::path& file, uint64_t offset, uint64_t len);
+    void unmap();
+
+    const uint8_t* data() const { return ptr; }
+    uint64_t size() const { return length; }
+
+private:
+    void* base = nullptr;
+    size_t mapped = 0;
+    const uint8_t* ptr = nullptr;
+    uint64_t length = 0;
+};
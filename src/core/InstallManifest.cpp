@@ -0,0 +1,174 @@
+#include "InstallManifest.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace {
+
+std::string normalize(std::string_view relPath) {
+    std::string p(relPath);
+    for (auto& c : p) {
+        if (c == '\\') c = '/';
+    }
+    while (p.rfind("./", 0) == 0) p.erase(0, 2);
+    while (!p.empty() && p.back() == '/') p.pop_back();
+    return p;
+}
+
+template <typename T>
+void put(std::string& out, T v) {
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        out.push_back((char)((uint64_t)v >> (8 * i)));
+    }
+}
+
+template <typename T>
+bool get(const std::string& in, size_t& off, T& v) {
+    if (off + sizeof(T) > in.size()) return false;
+    uint64_t r = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        r |= (uint64_t)(uint8_t)in[off + i] << (8 * i);
+    }
+    v = (T)r;
+    off += sizeof(T);
+    return true;
+}
+
+void putPath(std::string& out, std::string& prev, const std::string& path) {
+    size_t shared = 0;
+    size_t limit = std::min<size_t>(std::min(prev.size(), path.size()), 0xFFFF);
+    while (shared < limit && prev[shared] == path[shared]) ++shared;
+    size_t suffix = std::min<size_t>(path.size() - shared, 0xFFFF);
+    put<uint16_t>(out, (uint16_t)shared);
+    put<uint16_t>(out, (uint16_t)suffix);
+    out.append(path, shared, suffix);
+    prev = path;
+}
+
+} // namespace
+
+void InstallManifest::addFile(std::string_view relPath, uint64_t size) {
+    std::string p = normalize(relPath);
+    if (p.empty()) return;
+    size_t slash = p.rfind('/');
+    if (slash != std::string::npos) {
+        std::string_view parent(p.data(), slash);
+        // Files mostly arrive grouped by directory; only a new parent needs the walk up
+        if (parent != lastParent) {
+            addDirectory(parent);
+            lastParent.assign(parent);
+        }
+    }
+    fileEntries.push_back({std::move(p), size});
+    bytes += size;
+}
+
+void InstallManifest::reserve(size_t files, size_t dirs) {
+    fileEntries.reserve(files);
+    dirEntries.reserve(dirs);
+    knownDirs.reserve(dirs);
+}
+
+void InstallManifest::addDirectory(std::string_view relPath) {
+    std::string p = normalize(relPath);
+    // Walk up until an already-known ancestor so every intermediate directory is listed once
+    while (!p.empty() && knownDirs.insert(p).second) {
+        dirEntries.push_back(p);
+        size_t slash = p.rfind('/');
+        if (slash == std::string::npos) break;
+        p.resize(slash);
+    }
+}
+
+bool InstallManifest::save(const std::filesystem::path& file) const {
+    std::string out;
+    out.reserve(48 + fileEntries.size() * 32 + dirEntries.size() * 16);
+    out.append(MIKO_MANIFEST_MAGIC, sizeof(MIKO_MANIFEST_MAGIC));
+    put<uint32_t>(out, MIKO_MANIFEST_VERSION);
+    put<uint32_t>(out, 0);
+    put<uint64_t>(out, fileEntries.size());
+    put<uint64_t>(out, dirEntries.size());
+    put<uint64_t>(out, bytes);
+    std::string prev;
+    for (const auto& f : fileEntries) {
+        out.push_back(0);
+        put<uint64_t>(out, f.size);
+        putPath(out, prev, f.path);
+    }
+    for (const auto& d : dirEntries) {
+        out.push_back(1);
+        putPath(out, prev, d);
+    }
+
+    std::ofstream fo(file, std::ios::binary | std::ios::trunc);
+    if (!fo) return false;
+    fo.write(out.data(), (std::streamsize)out.size());
+    return (bool)fo;
+}
+
+bool InstallManifest::load(const std::filesystem::path& file) {
+    std::ifstream fi(file, std::ios::binary);
+    if (!fi) return false;
+    std::string in((std::istreambuf_iterator<char>(fi)), std::istreambuf_iterator<char>());
+
+    size_t off = 0;
+    if (in.size() < sizeof(MIKO_MANIFEST_MAGIC) || memcmp(in.data(), MIKO_MANIFEST_MAGIC, sizeof(MIKO_MANIFEST_MAGIC)) != 0) {
+        return false;
+    }
+    off += sizeof(MIKO_MANIFEST_MAGIC);
+    uint32_t version = 0, reserved = 0;
+    uint64_t fileCount = 0, dirCount = 0, totalBytes = 0;
+    if (!get(in, off, version) || version != MIKO_MANIFEST_VERSION) return false;
+    if (!get(in, off, reserved) || !get(in, off, fileCount) || !get(in, off, dirCount) || !get(in, off, totalBytes)) {
+        return false;
+    }
+
+    InstallManifest m;
+    // Counts come from the file; cap the reservation so a corrupt header cannot request terabytes
+    m.fileEntries.reserve((size_t)std::min<uint64_t>(fileCount, in.size() / 13));
+    m.dirEntries.reserve((size_t)std::min<uint64_t>(dirCount, in.size() / 5));
+    std::string path;
+    for (uint64_t i = 0; i < fileCount + dirCount; ++i) {
+        uint8_t kind = 0;
+        uint64_t size = 0;
+        uint16_t shared = 0, suffix = 0;
+        if (!get(in, off, kind)) return false;
+        if (kind == 0 && !get(in, off, size)) return false;
+        if (!get(in, off, shared) || !get(in, off, suffix)) return false;
+        if (shared > path.size() || off + suffix > in.size()) return false;
+        path.resize(shared);
+        path.append(in, off, suffix);
+        off += suffix;
+        if (kind == 0) {
+            m.fileEntries.push_back({path, size});
+        } else {
+            m.knownDirs.insert(path);
+            m.dirEntries.push_back(path);
+        }
+    }
+    m.bytes = totalBytes;
+    *this = std::move(m);
+    return true;
+}
+
+InstallManifest InstallManifest::scan(const std::filesystem::path& root) {
+    InstallManifest m;
+    std::error_code ec;
+    auto it = std::filesystem::recursive_directory_iterator(root, std::filesystem::directory_options::skip_permission_denied, ec);
+    for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        std::string rel = it->path().lexically_relative(root).generic_u8string();
+        std::error_code sec;
+        if (it->is_directory(sec) && !it->is_symlink(sec)) {
+            m.addDirectory(rel);
+        } else {
+            uint64_t size = it->is_regular_file(sec) ? (uint64_t)it->file_size(sec) : 0;
+            m.addFile(rel, sec ? 0 : size);
+        }
+    }
+    return m;
+}
+
+std::filesystem::path manifestPath(const std::filesystem::path& root, const std::string& relPath) {
+    return root / std::filesystem::u8path(relPath);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+// Binary record of everything an install created, written by the installer into the
+// install root and consumed by the uninstaller.
+// Layout (all integers little-endian):
+// magic: "MIKOMNFT" (8 bytes), version: uint32, reserved: uint32
+// counts: uint64 file_count, uint64 dir_count, uint64 total_bytes
+// records (file_count + dir_count), paths relative to the install root, '/' separated, UTF-8:
+//   uint8 kind (0 = file, 1 = directory)
+//   uint64 size (files only)
+//   uint16 shared prefix length with the previous record's path, uint16 suffix length, suffix bytes
+
+static const char MIKO_MANIFEST_MAGIC[8] = {'M','I','K','O','M','N','F','T'};
+static const uint32_t MIKO_MANIFEST_VERSION = 1;
+static const char MIKO_MANIFEST_FILE[] = "install.manifest";
+
+struct ManifestEntry {
+    std::string path; // relative, '/' separated
+    uint64_t size = 0;
+};
+
+class InstallManifest {
+public:
+    // Records a file; its parent directories are recorded implicitly
+    void addFile(std::string_view relPath, uint64_t size);
+    void addDirectory(std::string_view relPath);
+    // Pre-sizes storage when the counts are known up front
+    void reserve(size_t files, size_t dirs);
+
+    bool save(const std::filesystem::path& file) const;
+    bool load(const std::filesystem::path& file);
+    // Builds a manifest from what is on disk, for installs that predate the manifest
+    static InstallManifest scan(const std::filesystem::path& root);
+
+    const std::vector<ManifestEntry>& files() const { return fileEntries; }
+    const std::vector<std::string>& directories() const { return dirEntries; }
+    uint64_t totalBytes() const { return bytes; }
+    bool empty() const { return fileEntries.empty() && dirEntries.empty(); }
+
+private:
+    std::vector<ManifestEntry> fileEntries;
+    std::vector<std::string> dirEntries;
+    std::unordered_set<std::string> knownDirs;
+    std::string lastParent; // parent of the previous addFile(), already in knownDirs
+    uint64_t bytes = 0;
+};
+
+// Converts a manifest-relative UTF-8 path into a native path under root
+std::filesystem::path manifestPath(const std::filesystem::path& root, const std::string& relPath);
@@ -0,0 +1,368 @@
+#include "OutputFile.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Unbuffered I/O wants addresses, lengths and offsets in whole sectors; a page covers them
+const size_t IO_ALIGN = 4096;
+
+} // namespace
+
+#ifdef _WIN32
+
+SourceFile::~SourceFile() {}
+
+bool SourceFile::open(const std::filesystem::path&) {
+    return false;
+}
+
+bool OutputFile::canCopy() const {
+    return false;
+}
+
+bool OutputFile::copyFrom(SourceFile&, uint64_t, uint64_t) {
+    return false;
+}
+
+bool OutputFile::open(int, const char*, const char* fullPath, Mode m) {
+    fill = 0;
+    offset = 0;
+    bool whole = buf && cap && cap % IO_ALIGN == 0 && reinterpret_cast<uintptr_t>(buf) % IO_ALIGN == 0;
+    mode = whole ? m : Mode::Buffered;
+    direct = false;
+    std::wstring path = fs::u8path(fullPath).wstring();
+    if (mode == Mode::Unbuffered) {
+        handle = CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                             FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING, nullptr);
+        direct = handle != INVALID_HANDLE_VALUE;
+        stats.fileOpens.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (!direct) {
+        handle = CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        stats.fileOpens.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (handle == INVALID_HANDLE_VALUE) {
+        handle = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void OutputFile::preallocate(uint64_t size) {
+    if (!handle || !size) return;
+    FILE_ALLOCATION_INFO info;
+    info.AllocationSize.QuadPart = (LONGLONG)size;
+    SetFileInformationByHandle(handle, FileAllocationInfo, &info, sizeof(info));
+}
+
+bool OutputFile::writeOut(const uint8_t* data, size_t len) {
+    while (len) {
+        DWORD chunk = (DWORD)std::min<size_t>(len, 1u << 30), done = 0;
+        stats.writes.fetch_add(1, std::memory_order_relaxed);
+        if (!WriteFile(handle, data, chunk, &done, nullptr) || !done) return false;
+        data += done;
+        len -= done;
+        offset += done;
+    }
+    return true;
+}
+
+bool OutputFile::isOpen() const {
+    return handle != nullptr;
+}
+
+#else
+
+SourceFile::~SourceFile() {
+    if (fd >= 0) ::close(fd);
+}
+
+bool SourceFile::open(const std::filesystem::path& path) {
+#ifdef __linux__
+    if (fd < 0) fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    return fd >= 0;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+bool OutputFile::canCopy() const {
+#ifdef __linux__
+    return fd >= 0 && !direct;
+#else
+    return false;
+#endif
+}
+
+bool OutputFile::copyFrom(SourceFile& source, uint64_t srcOffset, uint64_t len) {
+    if (!source.isOpen() || !canCopy() || !flush()) return false;
+    stats.copiedBytes.fetch_add(len, std::memory_order_relaxed);
+#ifdef __linux__
+    auto unsupported = [](int e) { return e == EXDEV || e == EINVAL || e == ENOSYS || e == EOPNOTSUPP; };
+#ifdef FICLONERANGE
+    // Only whole blocks can be shared; the tail is copied below
+    uint64_t whole = len / IO_ALIGN * IO_ALIGN;
+    if (source.clones && whole && srcOffset % IO_ALIGN == 0 && offset % IO_ALIGN == 0) {
+        file_clone_range range{};
+        range.src_fd = source.fd;
+        range.src_offset = srcOffset;
+        range.src_length = whole;
+        range.dest_offset = offset;
+        stats.copies.fetch_add(1, std::memory_order_relaxed);
+        if (::ioctl(fd, FICLONERANGE, &range) == 0) {
+            srcOffset += whole;
+            len -= whole;
+            offset += whole;
+            // The clone leaves the file position alone; later writes append after it
+            if (::lseek(fd, (off_t)offset, SEEK_SET) < 0) return false;
+        } else if (unsupported(errno)) {
+            source.clones = false;
+        } else {
+            return false;
+        }
+    }
+#endif
+    while (len) {
+        loff_t in = (loff_t)srcOffset;
+        ssize_t n = ::copy_file_range(source.fd, &in, fd, nullptr, (size_t)std::min<uint64_t>(len, 1u << 30), 0);
+        stats.copies.fetch_add(1, std::memory_order_relaxed);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && unsupported(errno)) break;
+        if (n <= 0) return false;
+        srcOffset += (uint64_t)n;
+        len -= (uint64_t)n;
+        offset += (uint64_t)n;
+    }
+    while (len) {
+        off_t in = (off_t)srcOffset;
+        ssize_t n = ::sendfile(fd, source.fd, &in, (size_t)std::min<uint64_t>(len, 1u << 30));
+        stats.copies.fetch_add(1, std::memory_order_relaxed);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && unsupported(errno)) break;
+        if (n <= 0) return false;
+        srcOffset += (uint64_t)n;
+        len -= (uint64_t)n;
+        offset += (uint64_t)n;
+    }
+#endif
+    while (len) {
+        ssize_t n = ::pread(source.fd, buf, (size_t)std::min<uint64_t>(len, cap), (off_t)srcOffset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0 || !writeOut(buf, (size_t)n)) return false;
+        srcOffset += (uint64_t)n;
+        len -= (uint64_t)n;
+    }
+    return true;
+}
+
+bool OutputFile::open(int dirFd, const char* name, const char* fullPath, Mode m) {
+    fill = 0;
+    offset = 0;
+    bool whole = buf && cap && cap % IO_ALIGN == 0 && reinterpret_cast<uintptr_t>(buf) % IO_ALIGN == 0;
+    mode = whole ? m : Mode::Buffered;
+    direct = false;
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    auto openWith = [&](int extra) {
+        stats.fileOpens.fetch_add(1, std::memory_order_relaxed);
+        return dirFd >= 0 ? ::openat(dirFd, name, flags | extra, 0666) : ::open(fullPath, flags | extra, 0666);
+    };
+    fd = -1;
+#ifdef O_DIRECT
+    // tmpfs and some network filesystems refuse O_DIRECT; those get ordinary writes
+    if (mode == Mode::Unbuffered) {
+        fd = openWith(O_DIRECT);
+        direct = fd >= 0;
+    }
+#endif
+    if (fd < 0) fd = openWith(0);
+#ifdef F_NOCACHE
+    // macOS: no O_DIRECT, but the same effect per descriptor
+    if (fd >= 0 && mode == Mode::Unbuffered) direct = fcntl(fd, F_NOCACHE, 1) == 0;
+#endif
+    return fd >= 0;
+}
+
+void OutputFile::preallocate(uint64_t size) {
+    if (fd < 0 || !size) return;
+#if defined(__linux__)
+    // KEEP_SIZE: blocks are reserved, but a file cut short never shows a tail of zeros
+    ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)size);
+#elif defined(F_PREALLOCATE)
+    fstore_t store = {F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, (off_t)size, 0};
+    if (fcntl(fd, F_PREALLOCATE, &store) != 0) {
+        store.fst_flags = F_ALLOCATEALL;
+        fcntl(fd, F_PREALLOCATE, &store);
+    }
+#else
+    (void)size;
+#endif
+}
+
+bool OutputFile::writeOut(const uint8_t* data, size_t len) {
+    while (len) {
+        ssize_t n = ::write(fd, data, len);
+        stats.writes.fetch_add(1, std::memory_order_relaxed);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        len -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return true;
+}
+
+bool OutputFile::isOpen() const {
+    return fd >= 0;
+}
+
+#endif
+
+bool OutputFile::write(const uint8_t* data, size_t len) {
+    if (mode != Mode::Buffered) {
+        // Page-aligned input, such as a mapped stored entry, meets the same rules as the
+        // buffer: its whole buffers go out from where they are, without the copy
+        if (!fill && reinterpret_cast<uintptr_t>(data) % IO_ALIGN == 0 && len >= cap) {
+            size_t whole = len / cap * cap;
+            if (!writeOut(data, whole)) return false;
+            data += whole;
+            len -= whole;
+        }
+        // Whole buffers only, so every write is aligned in memory, in length and in the file
+        while (len) {
+            size_t take = std::min(len, cap - fill);
+            memcpy(buf + fill, data, take);
+            fill += take;
+            data += take;
+            len -= take;
+            if (fill == cap && !flush()) return false;
+        }
+        return true;
+    }
+    if (fill + len <= cap) {
+        memcpy(buf + fill, data, len);
+        fill += len;
+        return true;
+    }
+    if (!flush()) return false;
+    if (len >= cap) return writeOut(data, len);
+    memcpy(buf, data, len);
+    fill = len;
+    return true;
+}
+
+bool OutputFile::flush() {
+    if (!fill) return true;
+    size_t len = fill;
+    fill = 0;
+    if (!direct || len % IO_ALIGN == 0) return writeOut(buf, len);
+    // The tail of an unbuffered file: write whole sectors, then cut the padding off
+    uint64_t end = offset + len;
+    size_t padded = (len + IO_ALIGN - 1) / IO_ALIGN * IO_ALIGN;
+    memset(buf + len, 0, padded - len);
+    if (!writeOut(buf, padded)) return false;
+    offset = end;
+#ifdef _WIN32
+    FILE_END_OF_FILE_INFO info;
+    info.EndOfFile.QuadPart = (LONGLONG)end;
+    return SetFileInformationByHandle(handle, FileEndOfFileInfo, &info, sizeof(info)) != 0;
+#else
+    return ::ftruncate(fd, (off_t)end) == 0;
+#endif
+}
+
+bool OutputFile::sync() {
+    if (!isOpen() || !flush()) return false;
+    stats.syncs.fetch_add(1, std::memory_order_relaxed);
+#if defined(_WIN32)
+    return FlushFileBuffers(handle) != 0;
+#elif defined(__linux__)
+    // The size is the only metadata a reader needs, and fdatasync covers it
+    return ::fdatasync(fd) == 0;
+#else
+    return ::fsync(fd) == 0;
+#endif
+}
+
+bool OutputFile::close() {
+    if (!isOpen()) return true;
+    bool ok = flush();
+#ifdef _WIN32
+    ok = CloseHandle(handle) != 0 && ok;
+    handle = nullptr;
+#else
+    ok = ::close(fd) == 0 && ok;
+    fd = -1;
+#endif
+    stats.closes.fetch_add(1, std::memory_order_relaxed);
+    return ok;
+}
+
+void OutputFile::discard() {
+    if (!isOpen()) return;
+#ifdef _WIN32
+    CloseHandle(handle);
+    handle = nullptr;
+#else
+    ::close(fd);
+    fd = -1;
+#endif
+    stats.closes.fetch_add(1, std::memory_order_relaxed);
+    fill = 0;
+}
+
+#ifdef _WIN32
+
+bool replaceFile(int, const char*, const char*, const char* fullFrom, const char* fullTo, ExtractIoStats& stats) {
+    std::error_code ec;
+    fs::path from = fs::u8path(fullFrom), to = fs::u8path(fullTo);
+    stats.renames.fetch_add(1, std::memory_order_relaxed);
+    fs::rename(from, to, ec);
+    if (!ec) return true;
+    // Read-only targets refuse to be replaced; drop the attribute and retry once
+    fs::permissions(to, fs::perms::owner_write, fs::perm_options::add, ec);
+    ec.clear();
+    fs::rename(from, to, ec);
+    return !ec;
+}
+
+void removeFile(int, const char*, const char* fullPath) {
+    std::error_code ec;
+    fs::remove(fs::u8path(fullPath), ec);
+}
+
+#else
+
+bool replaceFile(int dirFd, const char* from, const char* to, const char* fullFrom, const char* fullTo,
+                 ExtractIoStats& stats) {
+    stats.renames.fetch_add(1, std::memory_order_relaxed);
+    if (dirFd >= 0) return ::renameat(dirFd, from, dirFd, to) == 0;
+    return ::rename(fullFrom, fullTo) == 0;
+}
+
+void removeFile(int dirFd, const char* name, const char* fullPath) {
+    if (dirFd >= 0) ::unlinkat(dirFd, name, 0);
+    else ::unlink(fullPath);
+}
+
+#endif
@@ -0,0 +1,91 @@
+#pragma once
+#include "DirTable.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+// The setup file opened for reading, the source of OutputFile::copyFrom()
+class SourceFile {
+public:
+    SourceFile() = default;
+    ~SourceFile();
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    // False where files cannot be copied in the kernel, so callers read them instead
+    bool open(const std::filesystem::path& path);
+    bool isOpen() const { return fd >= 0; }
+
+private:
+    friend class OutputFile;
+    int fd = -1;
+    bool clones = true; // cleared once the filesystem refuses to share extents
+};
+
+// A file being written by the extractor, through a caller-owned buffer and the OS's own
+// calls: on POSIX a descriptor opened with openat() relative to its parent's handle, on
+// Windows a CreateFileW() handle over the full path.
+class OutputFile {
+public:
+    enum class Mode {
+        Buffered,   // small writes gathered in the buffer, large ones straight through
+        Aligned,    // only whole buffers at buffer-aligned offsets, for large files; page-aligned
+                    // input of a buffer or more is written in place
+        Unbuffered, // Aligned, bypassing the page cache (O_DIRECT, FILE_FLAG_NO_BUFFERING)
+                    // where the filesystem allows it; needs a page-aligned buffer
+    };
+
+    explicit OutputFile(ExtractIoStats& stats) : stats(stats) {}
+    ~OutputFile() { discard(); }
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    void setBuffer(uint8_t* buffer, size_t size) { buf = buffer; cap = size; }
+
+    // Creates or truncates `name` in the directory `dirFd`, or `fullPath` when there is no
+    // handle (Windows, or the directory could not be opened); both NUL-terminated UTF-8.
+    // Aligned modes fall back to Buffered without a buffer of whole pages.
+    bool open(int dirFd, const char* name, const char* fullPath, Mode mode = Mode::Buffered);
+    // Reserves `size` bytes so the file is laid out in one piece instead of being extended
+    // write by write; only a hint, so failures are ignored
+    void preallocate(uint64_t size);
+    bool write(const uint8_t* data, size_t len);
+    // True when copyFrom() can be used: Linux, and not opened for direct I/O
+    bool canCopy() const;
+    // Appends `len` bytes of `source` from `srcOffset` without passing them through memory:
+    // a reflink where source and destination share a copy-on-write filesystem and the
+    // offsets are block aligned, else copy_file_range(), else sendfile(), else (only there)
+    // a read into the buffer
+    bool copyFrom(SourceFile& source, uint64_t srcOffset, uint64_t len);
+    // Writes out the buffer and waits until the data is on stable storage
+    bool sync();
+    // Flushes and closes; false when any write or the close failed
+    bool close();
+    // Closes without flushing, e.g. before removing a half-written file
+    void discard();
+    bool isOpen() const;
+
+private:
+    bool flush();
+    bool writeOut(const uint8_t* data, size_t len);
+
+    ExtractIoStats& stats;
+    uint8_t* buf = nullptr;
+    size_t cap = 0;
+    size_t fill = 0;
+    Mode mode = Mode::Buffered;
+    bool direct = false; // opened with O_DIRECT / FILE_FLAG_NO_BUFFERING
+    uint64_t offset = 0; // bytes handed to the OS so far
+#ifdef _WIN32
+    void* handle = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+// Renames `from` over `to` within one directory (handle, or full paths without one)
+bool replaceFile(int dirFd, const char* from, const char* to, const char* fullFrom, const char* fullTo,
+                 ExtractIoStats& stats);
+// Removes a file, ignoring errors
+void removeFile(int dirFd, const char* name, const char* fullPath);
@@ -0,0 +1,277 @@
+#include "Patch.h"
+#include "InstallManifest.h"
+#include "StagedInstall.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+uint64_t readU64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; --i) v = (v << 8) | p[i];
+    return v;
+}
+
+bool copyBytes(std::istream& in, std::ostream& out, uint64_t len, std::vector<char>& buf) {
+    while (len) {
+        size_t n = (size_t)std::min<uint64_t>(len, buf.size());
+        if (!in.read(buf.data(), (std::streamsize)n)) return false;
+        if (!out.write(buf.data(), (std::streamsize)n)) return false;
+        len -= n;
+    }
+    return true;
+}
+
+bool fail(std::string* error, const std::string& message) {
+    if (error) *error = message;
+    return false;
+}
+
+// Removes now-empty directories from `dir` upwards, stopping at root or at one the new
+// version still ships
+void pruneEmptyParents(fs::path dir, const fs::path& root, const std::unordered_set<std::string>& keep) {
+    std::error_code ec;
+    while (dir != root && !keep.count(dir.lexically_relative(root).generic_u8string()) &&
+           fs::is_empty(dir, ec) && !ec) {
+        if (!fs::remove(dir, ec)) break;
+        dir = dir.parent_path();
+    }
+}
+
+// Recreates the tree under `from` in `to`, each file a hard link to the installed one (a
+// copy where the filesystem has no links). Nothing may then write to a staged file in
+// place: it is replaced by rename, which leaves the installed contents alone.
+bool linkTree(const fs::path& from, const fs::path& to, std::string* error) {
+    std::error_code ec;
+    fs::recursive_directory_iterator it(from, ec), end;
+    for (; !ec && it != end; it.increment(ec)) {
+        fs::path dest = to / it->path().lexically_relative(from);
+        std::error_code op;
+        if (it->is_symlink(op)) {
+            fs::copy_symlink(it->path(), dest, op);
+        } else if (it->is_directory(op)) {
+            fs::create_directory(dest, op);
+        } else {
+            fs::create_hard_link(it->path(), dest, op);
+            if (op) {
+                op.clear();
+                fs::copy_file(it->path(), dest, op);
+            }
+        }
+        if (op) return fail(error, "cannot stage " + it->path().u8string());
+    }
+    return !ec || fail(error, "cannot read " + from.u8string());
+}
+
+// Flushes what apply() wrote into the staging tree besides the extractor's files, which it
+// flushed itself: the rebuilt files and manifest in `written`, and with DirectoryBarriers
+// every directory below the staging root, as the linked tree's were never flushed
+bool flushStaging(const fs::path& staging, const std::vector<fs::path>& written, Durability durability) {
+    if (durability == Durability::None) return true;
+    if (durability == Durability::SyncAtEnd && syncFilesystem(staging)) return true;
+    bool ok = true;
+    for (const auto& file : written) ok = syncFile(file) && ok;
+    if (durability == Durability::DirectoryBarriers) {
+        std::error_code ec;
+        fs::recursive_directory_iterator it(staging, ec), end;
+        for (; !ec && it != end; it.increment(ec)) {
+            std::error_code op;
+            if (it->is_directory(op) && !it->is_symlink(op)) ok = syncDirectory(it->path()) && ok;
+        }
+        ok = ok && !ec;
+    }
+    return ok;
+}
+
+} // namespace
+
+bool loadPatchPlan(const PayloadReader& payload, PatchPlan& plan) {
+    const std::string* s = payload.section(MIKO_SECTION_PATCH);
+    if (!s) return false;
+    size_t offset = 0;
+    plan.bases = parseFileHashTable(*s, offset);
+    plan.removed.clear();
+    if (s->size() - offset < 8) return false;
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(s->data()) + offset;
+    const uint8_t* end = reinterpret_cast<const uint8_t*>(s->data()) + s->size();
+    uint64_t count = readU64(p);
+    p += 8;
+    for (uint64_t i = 0; i < count; ++i) {
+        if (end - p < 2) return false;
+        size_t len = (size_t)p[0] | ((size_t)p[1] << 8);
+        p += 2;
+        if ((size_t)(end - p) < len) return false;
+        plan.removed.emplace_back(reinterpret_cast<const char*>(p), len);
+        p += len;
+    }
+    for (const auto& b : plan.bases) {
+        if (!isSafeEntryPath(b.path)) return false;
+    }
+    for (const auto& r : plan.removed) {
+        if (!isSafeEntryPath(r)) return false;
+    }
+    return true;
+}
+
+bool applyDelta(const fs::path& base, const fs::path& delta, const fs::path& target, std::string* error) {
+    std::ifstream d(delta, std::ios::binary);
+    std::ifstream b(base, std::ios::binary);
+    if (!d || !b) return fail(error, "cannot open delta input for " + target.u8string());
+    uint8_t header[24];
+    if (!d.read(reinterpret_cast<char*>(header), sizeof(header)) ||
+        memcmp(header, MIKO_DELTA_MAGIC, sizeof(MIKO_DELTA_MAGIC)) != 0) {
+        return fail(error, "not a delta: " + delta.u8string());
+    }
+    uint64_t baseSize = readU64(header + 8), targetSize = readU64(header + 16);
+    std::error_code ec;
+    if (fs::file_size(base, ec) != baseSize || ec) return fail(error, "delta base has the wrong size: " + base.u8string());
+
+    std::ofstream out(target, std::ios::binary | std::ios::trunc);
+    if (!out) return fail(error, "cannot create " + target.u8string());
+    std::vector<char> buf(1 << 20);
+    uint64_t produced = 0;
+    for (;;) {
+        uint8_t op[17];
+        if (!d.read(reinterpret_cast<char*>(op), 1)) break; // clean end of operations
+        if (op[0] == 1) {
+            if (!d.read(reinterpret_cast<char*>(op + 1), 16)) return fail(error, "truncated delta");
+            uint64_t off = readU64(op + 1), len = readU64(op + 9);
+            if (off > baseSize || len > baseSize - off) return fail(error, "delta copies outside its base");
+            b.seekg((std::streamoff)off, std::ios::beg);
+            if (!copyBytes(b, out, len, buf)) return fail(error, "cannot copy from " + base.u8string());
+            produced += len;
+        } else if (op[0] == 2) {
+            if (!d.read(reinterpret_cast<char*>(op + 1), 8)) return fail(error, "truncated delta");
+            uint64_t len = readU64(op + 1);
+            if (!copyBytes(d, out, len, buf)) return fail(error, "truncated delta");
+            produced += len;
+        } else {
+            return fail(error, "corrupt delta: " + delta.u8string());
+        }
+    }
+    out.close();
+    if (!out) return fail(error, "write failed: " + target.u8string());
+    if (produced != targetSize) return fail(error, "delta produced the wrong size for " + target.u8string());
+    return true;
+}
+
+Patcher::Patcher(const PayloadReader& payload, const fs::path& root, unsigned threads)
+    : payload(payload), root(root), verifier(threads) {}
+
+bool Patcher::checkPreconditions(VerifyReport* report) {
+    if (!planLoaded) {
+        if (!loadPatchPlan(payload, plan)) {
+            lastError = "payload is not a valid patch";
+            return false;
+        }
+        planLoaded = true;
+    }
+    VerifyReport r = verifier.verify(root, plan.bases);
+    bool ok = r.clean();
+    if (!ok) {
+        lastError = "installed files do not match the version this patch updates (" + r.issues.front().path + ")";
+    }
+    if (report) *report = std::move(r);
+    return ok;
+}
+
+bool Patcher::apply(const ExtractOptions& options) {
+    written = 0;
+    swapDone = false;
+    lastError.clear();
+    if (!checkPreconditions()) return false;
+
+    // The new version is assembled in a staging tree and swapped in whole, so a failure at
+    // any step leaves the install exactly as it was
+    StagedInstall stage{root, options.durability};
+    const fs::path& staging = stage.stagingPath();
+    auto abandon = [&](const std::string& message) {
+        if (lastError.empty()) lastError = message;
+        stage.rollback();
+        return false;
+    };
+    if (!stage.begin()) return abandon("cannot create " + staging.u8string());
+    if (!linkTree(root, staging, &lastError)) return abandon("cannot stage the installed files");
+
+    // Changed files replace their links one rename at a time; deltas land under
+    // MIKO_DELTA_PREFIX next to the files they rebuild
+    ExtractOptions opts = options;
+    opts.only = nullptr;
+    opts.replaceExisting = true;
+    Extractor extractor(payload, staging);
+    bool ok = extractor.run(opts);
+    written = extractor.bytesWritten();
+    if (!ok) return abandon(extractor.error());
+
+    std::error_code ec;
+    std::unordered_set<std::string> touched;
+    std::vector<fs::path> rewritten;
+    for (const auto& f : extractor.manifest().files()) {
+        if (f.path.compare(0, sizeof(MIKO_DELTA_PREFIX) - 1, MIKO_DELTA_PREFIX) != 0) touched.insert(f.path);
+    }
+    for (const auto& base : plan.bases) {
+        fs::path target = manifestPath(staging, base.path);
+        fs::path rebuilt = fs::path(target).concat(".miko-new");
+        if (!applyDelta(target, manifestPath(staging, MIKO_DELTA_PREFIX + base.path), rebuilt, &lastError)) {
+            return abandon("");
+        }
+        written += fs::file_size(rebuilt, ec);
+        fs::rename(rebuilt, target, ec);
+        if (ec) return abandon("cannot replace " + target.u8string());
+        touched.insert(base.path);
+        rewritten.push_back(target);
+    }
+    fs::remove_all(manifestPath(staging, std::string(MIKO_DELTA_PREFIX, sizeof(MIKO_DELTA_PREFIX) - 2)), ec);
+
+    // The patch TAR lists every directory of the new version
+    const auto& newDirs = extractor.manifest().directories();
+    std::unordered_set<std::string> keep(newDirs.begin(), newDirs.end());
+    for (const auto& path : plan.removed) {
+        fs::path p = manifestPath(staging, path);
+        fs::remove(p, ec);
+        pruneEmptyParents(p.parent_path(), staging, keep);
+    }
+
+    // Everything rewritten must now hash exactly as the new version's HASH section says
+    std::vector<PayloadFileHash> expected = payload.fileHashes();
+    std::vector<PayloadFileHash> check;
+    for (const auto& h : expected) {
+        if (touched.count(h.path)) check.push_back(h);
+    }
+    VerifyReport after = verifier.verify(staging, check);
+    if (!after.clean()) return abandon("patched file does not match the new version: " + after.issues.front().path);
+
+    // The new version's file list, plus the directories that are still there
+    InstallManifest updated;
+    InstallManifest previous;
+    previous.load(manifestPath(root, MIKO_MANIFEST_FILE));
+    for (const auto* dirs : {&previous.directories(), &extractor.manifest().directories()}) {
+        for (const auto& dir : *dirs) {
+            if (fs::is_directory(manifestPath(staging, dir), ec)) updated.addDirectory(dir);
+        }
+    }
+    for (const auto& h : expected) updated.addFile(h.path, h.size);
+    // The staged manifest is a link to the installed one: replace it, do not rewrite it
+    fs::path manifestFile = manifestPath(staging, MIKO_MANIFEST_FILE);
+    fs::remove(manifestFile, ec);
+    if (!updated.save(manifestFile)) return abandon("failed to write install manifest");
+    rewritten.push_back(manifestFile);
+
+    if (!flushStaging(staging, rewritten, options.durability)) return abandon("cannot flush the patched files");
+    bool committed = stage.commit();
+    swapDone = stage.swapped();
+    if (!committed) {
+        // A swap that went through but could not be flushed leaves nothing to roll back
+        if (swapDone) {
+            lastError = "cannot flush the swap into " + root.u8string();
+            return false;
+        }
+        return abandon("cannot replace " + root.u8string());
+    }
+    return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "Extractor.h"
+#include "Payload.h"
+#include "Verifier.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Parsed PTCH section of a patch payload (see format.h)
+struct PatchPlan {
+    std::vector<PayloadFileHash> bases; // installed files the deltas read, as they must be
+    std::vector<std::string> removed;   // files dropped since the base version
+};
+
+// False when the payload is a full setup or its PTCH section is malformed
+bool loadPatchPlan(const PayloadReader& payload, PatchPlan& plan);
+
+// Rebuilds `target` from `base` and a MIKODLT1 delta file; the three paths must differ
+bool applyDelta(const std::filesystem::path& base, const std::filesystem::path& delta,
+                const std::filesystem::path& target, std::string* error = nullptr);
+
+// Updates an existing installation from a patch payload. Every file a delta reads is
+// hashed before anything is written, so a patch is refused when the install is not the
+// version it was built against. The new version is built in a StagedInstall (unchanged
+// files linked, changed ones extracted, deltas rebuilt and verified) and only then swapped
+// in, so a failed or canceled patch leaves the old install untouched.
+class Patcher {
+public:
+    Patcher(const PayloadReader& payload, const std::filesystem::path& root, unsigned threads = 0);
+
+    // Hashes the delta bases; the report lists every one that does not match
+    bool checkPreconditions(VerifyReport* report = nullptr);
+    // Checks preconditions, then stages the new version (changed files, rebuilt deltas,
+    // removals, a new manifest), verifies what changed and commits it; rolls back on failure.
+    // options.durability covers the rebuilt files and the swap as well as the extraction.
+    bool apply(const ExtractOptions& options = ExtractOptions());
+
+    uint64_t bytesWritten() const { return written; }
+    // Whether the last apply() put the new version in place, even if it then failed to flush
+    // the swap (see StagedInstall::swapped())
+    bool swapped() const { return swapDone; }
+    const std::string& error() const { return lastError; }
+
+private:
+    const PayloadReader& payload;
+    std::filesystem::path root;
+    Verifier verifier;
+    PatchPlan plan;
+    bool planLoaded = false;
+    uint64_t written = 0;
+    bool swapDone = false;
+    std::string lastError;
+};
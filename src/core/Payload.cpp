@@ -0,0 +1,366 @@
+#include "Payload.h"
+#include "BufferPool.h"
+#include "FileView.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+
+uint64_t readU64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; --i) v = (v << 8) | p[i];
+    return v;
+}
+
+const size_t READ_CHUNK = 1 << 20;
+
+// Reads one coded region of the blob in READ_CHUNK slices, or hands out slices of it in
+// place when the region is mapped
+struct BlobInput {
+    std::ifstream& f;
+    uint64_t remaining;
+    std::atomic<uint64_t>* consumed;
+    const BufferPool::Buffer& buf;
+    const uint8_t* view = nullptr; // the rest of the region, when mapped
+
+    // Next slice of at most `limit` bytes, empty at the end of the region; false on a read error
+    bool next(const uint8_t*& data, size_t& len, uint64_t limit = UINT64_MAX) {
+        len = (size_t)std::min<uint64_t>(std::min<uint64_t>(remaining, buf.size()), limit);
+        data = view ? view : buf.data();
+        if (!len) return true;
+        if (view) view += len;
+        else if (!f.read(reinterpret_cast<char*>(buf.data()), (std::streamsize)len)) return false;
+        remaining -= len;
+        if (consumed) consumed->fetch_add(len);
+        return true;
+    }
+
+    // Moves past `len` bytes someone else consumed
+    bool skip(uint64_t len) {
+        if (len > remaining) return false;
+        if (view) view += len;
+        else if (!f.seekg((std::streamoff)len, std::ios::cur)) return false;
+        remaining -= len;
+        if (consumed) consumed->fetch_add(len);
+        return true;
+    }
+};
+
+bool copyStored(BlobInput& input, const PayloadReader::Sink& sink) {
+    for (;;) {
+        const uint8_t* data;
+        size_t len;
+        if (!input.next(data, len)) return false;
+        if (!len) return true;
+        if (!sink(data, len)) return false;
+    }
+}
+
+// copyStored(), offering each remaining part to `stored` before reading it; `fileOffset`
+// is where the region starts in the setup file
+bool offerStored(BlobInput& input, const PayloadReader::Sink& sink, const PayloadReader::StoredSink& stored,
+                 uint64_t fileOffset) {
+    while (input.remaining) {
+        uint64_t taken = 0, readAhead = 0;
+        if (!stored(fileOffset, input.remaining, taken, readAhead)) return false;
+        if (taken) {
+            if (!input.skip(taken)) return false;
+            fileOffset += taken;
+            continue;
+        }
+        const uint8_t* data;
+        size_t len;
+        if (!input.next(data, len, readAhead ? readAhead : UINT64_MAX)) return false;
+        fileOffset += len;
+        if (!sink(data, len)) return false;
+    }
+    return true;
+}
+
+// Decoders fail unless the input ends exactly where the stream does and, when `rawSize` is
+// known (block payloads; UINT64_MAX otherwise), exactly that many bytes came out
+bool decodeXz(BlobInput& input, const PayloadReader::Sink& sink, const BufferPool::Buffer& out,
+              uint64_t rawSize = UINT64_MAX) {
+#ifdef HAVE_LZMA
+    lzma_stream strm = LZMA_STREAM_INIT;
+    // Concatenated: legacy "LZMA" blobs are several independent .xz streams back to back
+    if (lzma_stream_decoder(&strm, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) return false;
+    lzma_ret ret = LZMA_OK;
+    bool ok = true;
+    while (ok && ret == LZMA_OK) {
+        if (strm.avail_in == 0 && input.remaining) {
+            const uint8_t* data;
+            size_t len;
+            if (!input.next(data, len)) { ok = false; break; }
+            strm.next_in = data;
+            strm.avail_in = len;
+        }
+        // Once LZMA_FINISH is used it must be used for every later call
+        lzma_action action = input.remaining ? LZMA_RUN : LZMA_FINISH;
+        strm.next_out = out.data();
+        strm.avail_out = out.size();
+        ret = lzma_code(&strm, action);
+        size_t produced = out.size() - strm.avail_out;
+        if (produced && !sink(out.data(), produced)) ok = false;
+    }
+    bool trailing = strm.avail_in || input.remaining;
+    uint64_t total = strm.total_out;
+    lzma_end(&strm);
+    return ok && ret == LZMA_STREAM_END && !trailing && (rawSize == UINT64_MAX || total == rawSize);
+#else
+    (void)input; (void)sink; (void)out; (void)rawSize;
+    return false;
+#endif
+}
+
+// `dict` primes "DFZD" blocks; zlib asks for it after reading the stream header
+bool decodeDeflate(BlobInput& input, const PayloadReader::Sink& sink, const BufferPool::Buffer& out,
+                   uint64_t rawSize, const std::string* dict = nullptr) {
+#ifdef HAVE_ZLIB
+    z_stream strm{};
+    if (inflateInit(&strm) != Z_OK) return false;
+    int ret = Z_OK;
+    bool ok = true;
+    uint64_t total = 0; // strm.total_out is a uLong, 32 bits on Windows
+    while (ok && ret != Z_STREAM_END) {
+        if (strm.avail_in == 0) {
+            const uint8_t* data;
+            size_t len;
+            if (!input.next(data, len) || !len) { ok = false; break; } // truncated block
+            strm.next_in = const_cast<Bytef*>(data);
+            strm.avail_in = (uInt)len;
+        }
+        strm.next_out = out.data();
+        strm.avail_out = (uInt)out.size();
+        ret = inflate(&strm, Z_NO_FLUSH);
+        if (ret == Z_NEED_DICT && dict) {
+            ret = inflateSetDictionary(&strm, reinterpret_cast<const Bytef*>(dict->data()), (uInt)dict->size());
+        }
+        if (ret != Z_OK && ret != Z_STREAM_END) ok = false;
+        size_t produced = out.size() - strm.avail_out;
+        total += produced;
+        if (ok && produced && !sink(out.data(), produced)) ok = false;
+    }
+    bool trailing = strm.avail_in || input.remaining;
+    inflateEnd(&strm);
+    return ok && !trailing && total == rawSize;
+#else
+    (void)input; (void)sink; (void)out; (void)rawSize; (void)dict;
+    return false;
+#endif
+}
+
+} // namespace
+
+bool PayloadReader::open(const std::filesystem::path& setupFile) {
+    std::ifstream f(setupFile, std::ios::binary);
+    if (!f) return false;
+    f.seekg(0, std::ios::end);
+    uint64_t size = (uint64_t)f.tellg();
+    if (size < (uint64_t)(MIKO_TRAILER_LEN + MIKO_MAGIC_LEN + MIKO_ALGO_LEN)) return false;
+
+    uint8_t trailer[MIKO_TRAILER_LEN];
+    f.seekg((std::streamoff)(size - MIKO_TRAILER_LEN), std::ios::beg);
+    f.read(reinterpret_cast<char*>(trailer), MIKO_TRAILER_LEN);
+    if (!f) return false;
+    uint64_t blobSize = readU64(trailer), sectionsSize = readU64(trailer + 8);
+    uint64_t metaSize = readU64(trailer + 16), magicOff = readU64(trailer + 24);
+    // Every size comes from the file, so check the sum without overflowing
+    uint64_t fixed = MIKO_MAGIC_LEN + MIKO_ALGO_LEN + MIKO_TRAILER_LEN;
+    if (magicOff > size || blobSize > size || sectionsSize > size || metaSize > size) return false;
+    if (magicOff + fixed + blobSize + sectionsSize + metaSize != size) return false;
+
+    char head[MIKO_MAGIC_LEN + MIKO_ALGO_LEN];
+    f.seekg((std::streamoff)magicOff, std::ios::beg);
+    f.read(head, sizeof(head));
+    if (!f || memcmp(head, MIKO_MAGIC, MIKO_MAGIC_LEN) != 0) return false;
+
+    std::string raw(sectionsSize, '\0');
+    f.seekg((std::streamoff)(magicOff + MIKO_MAGIC_LEN + MIKO_ALGO_LEN + blobSize), std::ios::beg);
+    f.read(&raw[0], (std::streamsize)sectionsSize);
+    std::string metaBytes(metaSize, '\0');
+    f.read(&metaBytes[0], (std::streamsize)metaSize);
+    if (!f) return false;
+
+    std::map<std::string, std::string> parsed;
+    for (size_t off = 0; off < raw.size();) {
+        if (raw.size() - off < (size_t)MIKO_SECTION_HEADER_LEN) return false;
+        const uint8_t* h = reinterpret_cast<const uint8_t*>(raw.data() + off);
+        uint64_t len = readU64(h + 8);
+        off += MIKO_SECTION_HEADER_LEN;
+        if (len > raw.size() - off) return false;
+        parsed[std::string(reinterpret_cast<const char*>(h), 4)] = raw.substr(off, (size_t)len);
+        off += (size_t)len;
+    }
+
+    file = setupFile;
+    algo.assign(head + MIKO_MAGIC_LEN, MIKO_ALGO_LEN);
+    blobOff = magicOff + MIKO_MAGIC_LEN + MIKO_ALGO_LEN;
+    blobLen = blobSize;
+    sections = std::move(parsed);
+    meta = std::move(metaBytes);
+    return true;
+}
+
+const std::string* PayloadReader::section(const char tag[4]) const {
+    auto it = sections.find(std::string(tag, 4));
+    return it == sections.end() ? nullptr : &it->second;
+}
+
+std::vector<PayloadFileHash> parseFileHashTable(const std::string& raw, size_t& offset) {
+    std::vector<PayloadFileHash> out;
+    if (raw.size() < offset || raw.size() - offset < 8) return out;
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(raw.data()) + offset;
+    const uint8_t* end = reinterpret_cast<const uint8_t*>(raw.data()) + raw.size();
+    uint64_t count = readU64(p);
+    p += 8;
+    out.reserve((size_t)std::min<uint64_t>(count, raw.size() / 42));
+    for (uint64_t i = 0; i < count; ++i) {
+        if (end - p < 42) break;
+        PayloadFileHash h;
+        h.size = readU64(p);
+        memcpy(h.sha256, p + 8, Sha256::DIGEST_SIZE);
+        size_t len = (size_t)p[40] | ((size_t)p[41] << 8);
+        p += 42;
+        if ((size_t)(end - p) < len) break;
+        h.path.assign(reinterpret_cast<const char*>(p), len);
+        p += len;
+        out.push_back(std::move(h));
+    }
+    offset = (size_t)(p - reinterpret_cast<const uint8_t*>(raw.data()));
+    return out;
+}
+
+std::vector<PayloadFileHash> PayloadReader::fileHashes() const {
+    const std::string* s = section(MIKO_SECTION_HASH);
+    if (!s) return {};
+    size_t offset = 0;
+    return parseFileHashTable(*s, offset);
+}
+
+std::vector<PayloadBlock> PayloadReader::blocks() const {
+    std::vector<PayloadBlock> out;
+    const std::string* s = section(MIKO_SECTION_BLOCKS);
+    if (!s || s->size() < 8) return out;
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(s->data());
+    uint64_t count = readU64(p);
+    if (count > (s->size() - 8) / MIKO_BLOCK_ENTRY_LEN) return out;
+    out.resize((size_t)count);
+    p += 8;
+    for (auto& b : out) {
+        b.offset = readU64(p);
+        b.compressedSize = readU64(p + 8);
+        b.rawSize = readU64(p + 16);
+        memcpy(b.codec, p + 24, 4);
+        b.flags = (uint32_t)p[28] | ((uint32_t)p[29] << 8) | ((uint32_t)p[30] << 16) | ((uint32_t)p[31] << 24);
+        p += MIKO_BLOCK_ENTRY_LEN;
+    }
+    return out;
+}
+
+bool PayloadReader::plan(InstallPlan& out) const {
+    const std::string* s = section(MIKO_SECTION_PLAN);
+    if (!s || s->size() < 40) return false;
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(s->data());
+    const uint8_t* end = p + s->size();
+    out.fileCount = readU64(p);
+    out.totalBytes = readU64(p + 8);
+    out.largestFile = readU64(p + 16);
+    out.archiveBytes = readU64(p + 24);
+    uint64_t dirCount = readU64(p + 32);
+    p += 40;
+    out.directories.clear();
+    out.directories.reserve((size_t)std::min<uint64_t>(dirCount, s->size() / 2));
+    for (uint64_t i = 0; i < dirCount; ++i) {
+        if (end - p < 2) return false;
+        size_t len = (size_t)p[0] | ((size_t)p[1] << 8);
+        p += 2;
+        if ((size_t)(end - p) < len) return false;
+        out.directories.emplace_back(reinterpret_cast<const char*>(p), len);
+        p += len;
+    }
+    out.blocks = blocks();
+    return true;
+}
+
+std::vector<BlockRun> splitBlockRuns(const std::vector<PayloadBlock>& blocks) {
+    std::vector<BlockRun> runs;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        if (runs.empty() || blocks[i].startsEntry()) {
+            BlockRun run;
+            run.first = i;
+            runs.push_back(run);
+        }
+        runs.back().count++;
+        runs.back().rawSize += blocks[i].rawSize;
+    }
+    return runs;
+}
+
+bool PayloadReader::decodeBlocks(const PayloadBlock* index, size_t count, const Sink& sink,
+                                 std::atomic<uint64_t>* consumed, BufferPool* buffers,
+                                 const StoredSink* stored) const {
+    std::ifstream f(file, std::ios::binary);
+    if (!f) return false;
+    BufferPool local(READ_CHUNK); // maps nothing unless used
+    BufferPool& pool = buffers ? *buffers : local;
+    BufferPool::Buffer in = pool.acquire(), out = pool.acquire();
+    if (!in || !out) return false;
+    const std::string* dict = section(MIKO_SECTION_DICT);
+    FileView view;
+    for (size_t i = 0; i < count; ++i) {
+        const PayloadBlock& b = index[i];
+        if (b.offset > blobLen || b.compressedSize > blobLen - b.offset) return false;
+        f.seekg((std::streamoff)(blobOff + b.offset), std::ios::beg);
+        BlobInput input{f, b.compressedSize, consumed, in};
+        bool ok = false;
+        // Stored blocks laid out for it are used in place: no read into a buffer, and their
+        // entries' data keeps its page alignment in memory
+        if (b.aligned() && memcmp(b.codec, MIKO_CODEC_STORE, 4) == 0 &&
+            view.map(file, blobOff + b.offset, b.compressedSize)) {
+            input.view = view.data();
+        }
+        if (memcmp(b.codec, MIKO_CODEC_STORE, 4) == 0) {
+            // Already-compressed entries go straight from the file to the sink
+            ok = stored ? offerStored(input, sink, *stored, blobOff + b.offset) : copyStored(input, sink);
+        } else if (memcmp(b.codec, MIKO_CODEC_LZMA, 4) == 0) {
+            ok = decodeXz(input, sink, out, b.rawSize);
+        } else if (memcmp(b.codec, MIKO_CODEC_DEFLATE, 4) == 0) {
+            ok = decodeDeflate(input, sink, out, b.rawSize);
+        } else if (memcmp(b.codec, MIKO_CODEC_DEFLATE_DICT, 4) == 0) {
+            ok = dict && decodeDeflate(input, sink, out, b.rawSize, dict);
+        }
+        if (!ok) return false;
+    }
+    return true;
+}
+
+bool PayloadReader::decode(const Sink& sink, std::atomic<uint64_t>* consumed, BufferPool* buffers,
+                           const StoredSink* stored) const {
+    if (algo == std::string(MIKO_ALGO_BLOCKS, 4)) {
+        std::vector<PayloadBlock> index = blocks();
+        if (index.empty() && blobLen) return false;
+        return decodeBlocks(index.data(), index.size(), sink, consumed, buffers, stored);
+    }
+
+    std::ifstream f(file, std::ios::binary);
+    if (!f) return false;
+    BufferPool local(READ_CHUNK);
+    BufferPool& pool = buffers ? *buffers : local;
+    BufferPool::Buffer in = pool.acquire(), out = pool.acquire();
+    if (!in || !out) return false;
+    f.seekg((std::streamoff)blobOff, std::ios::beg);
+    BlobInput input{f, blobLen, consumed, in};
+    if (algo == "NONE") return copyStored(input, sink);
+    // Older packers: one or more concatenated .xz streams without an index
+    if (algo == "LZMA") return decodeXz(input, sink, out);
+    return false;
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include "interface/installer/format.h"
+#include "Sha256.h"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+class BufferPool;
+
+// Expected state of one installed file, from the payload's HASH section
+struct PayloadFileHash {
+    std::string path;
+    uint64_t size = 0;
+    uint8_t sha256[Sha256::DIGEST_SIZE];
+};
+
+// One independently compressed block of the blob, from the BIDX section
+struct PayloadBlock {
+    uint64_t offset = 0; // within the blob
+    uint64_t compressedSize = 0;
+    uint64_t rawSize = 0;
+    char codec[4] = {'L','Z','M','A'}; // MIKO_CODEC_*
+    uint32_t flags = 0;                // MIKO_BLOCK_*
+
+    bool startsEntry() const { return (flags & MIKO_BLOCK_ENTRY_START) != 0; }
+    bool aligned() const { return (flags & MIKO_BLOCK_ENTRY_ALIGNED) != 0; }
+};
+
+// Blocks [first, first + count) of the index: one that starts on a TAR header and the
+// continuation blocks after it. Runs unpack independently of each other.
+struct BlockRun {
+    size_t first = 0;
+    size_t count = 0;
+    uint64_t rawSize = 0;
+};
+
+// Groups a block index into runs, in blob order
+std::vector<BlockRun> splitBlockRuns(const std::vector<PayloadBlock>& blocks);
+
+// Totals from the PLAN section, known before any of the blob is decoded
+struct InstallPlan {
+    uint64_t fileCount = 0;
+    uint64_t totalBytes = 0;   // sum of regular file sizes
+    uint64_t largestFile = 0;
+    uint64_t archiveBytes = 0; // uncompressed TAR size
+    std::vector<std::string> directories; // TAR order, parents before children
+    std::vector<PayloadBlock> blocks;
+};
+
+// Decodes a HASH-layout table (count, then size/digest/path records) starting at `offset`,
+// which is advanced past it. Truncated input yields the records read so far.
+std::vector<PayloadFileHash> parseFileHashTable(const std::string& raw, size_t& offset);
+
+// Read-only view of a MIKOSETUP payload appended to a setup executable (see format.h).
+// Sections and metadata are small and loaded by open(); the blob is only streamed.
+class PayloadReader {
+public:
+    // Sink for decoded TAR bytes; return false to stop decoding
+    using Sink = std::function<bool(const uint8_t* data, size_t len)>;
+    // Offered each remaining part of a "STOR" block, as a range of the setup file, before
+    // it is read. Either consume a prefix in place (e.g. copy it file to file) and set
+    // `taken`, or leave taken 0 and set `readAhead` to how much should go through the Sink
+    // before the next offer (0: a full buffer). Return false to stop decoding.
+    using StoredSink = std::function<bool(uint64_t fileOffset, uint64_t len, uint64_t& taken, uint64_t& readAhead)>;
+
+    bool open(const std::filesystem::path& setupFile);
+
+    const std::filesystem::path& path() const { return file; }
+    std::string algorithm() const { return algo; }
+    uint64_t blobOffset() const { return blobOff; }
+    uint64_t blobSize() const { return blobLen; }
+    const std::string& metadata() const { return meta; }
+
+    // Raw section bytes, or nullptr when the packer did not write that section
+    const std::string* section(const char tag[4]) const;
+    // Parsed HASH section; empty for payloads packed without digests
+    std::vector<PayloadFileHash> fileHashes() const;
+    // Parsed BIDX section; empty for single-stream payloads
+    std::vector<PayloadBlock> blocks() const;
+    // PLAN plus BIDX; false for payloads packed without a plan
+    bool plan(InstallPlan& out) const;
+
+    // Streams the decoded TAR to sink. `consumed`, when given, tracks compressed bytes read
+    // so callers can report progress against blobSize(). Read and decode buffers come from
+    // `buffers` when given, else from a pool private to the call. Stored blocks of a "BLKS"
+    // blob are offered to `stored` first when given.
+    bool decode(const Sink& sink, std::atomic<uint64_t>* consumed = nullptr, BufferPool* buffers = nullptr,
+                const StoredSink* stored = nullptr) const;
+    // Streams the decoded bytes of `count` blocks from a "BLKS" index; safe to call from
+    // several threads at once, each reading through its own file handle
+    bool decodeBlocks(const PayloadBlock* blocks, size_t count, const Sink& sink,
+                      std::atomic<uint64_t>* consumed = nullptr, BufferPool* buffers = nullptr,
+                      const StoredSink* stored = nullptr) const;
+
+private:
+    std::filesystem::path file;
+    std::string algo;
+    uint64_t blobOff = 0;
+    uint64_t blobLen = 0;
+    std::map<std::string, std::string> sections;
+    std::string meta;
+};
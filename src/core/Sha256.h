@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// SHA-256 (FIPS 180-4). Matches Python's hashlib.sha256, which the packer uses to record
+// per-file digests.
+class Sha256 {
+public:
+    static const size_t DIGEST_SIZE = 32;
+
+    Sha256() { reset(); }
+    void reset();
+    void update(const void* data, size_t len);
+    void final(uint8_t out[DIGEST_SIZE]);
+
+    static std::string toHex(const uint8_t digest[DIGEST_SIZE]);
+
+private:
+    void compress(const uint8_t block[64]);
+
+    uint32_t state[8];
+    uint64_t totalLen;
+    uint8_t buffer[64];
+    size_t bufferLen;
+};
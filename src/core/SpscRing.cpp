@@ -0,0 +1,92 @@
+#include "SpscRing.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+const int SPIN_LIMIT = 256;
+
+} // namespace
+
+SpscRing::SpscRing(size_t slotCount, size_t slotSize)
+    : size(slotSize), slots(std::max<size_t>(2, slotCount)), lengths(slots.size(), 0) {
+    for (auto& s : slots) s.resize(size);
+}
+
+template <typename Ready>
+void SpscRing::wait(Ready ready, std::atomic<bool>& parked, std::atomic<uint64_t>& waits) {
+    if (ready()) return;
+    waits.fetch_add(1, std::memory_order_relaxed);
+    for (int i = 0; i < SPIN_LIMIT; ++i) {
+        if (ready()) return;
+        std::this_thread::yield();
+    }
+    parks.fetch_add(1, std::memory_order_relaxed);
+    std::unique_lock<std::mutex> lock(parkMutex);
+    // The flag is set before the final check, and wake() reads it after moving its index,
+    // so one of the two always sees the other (both are sequentially consistent)
+    parked.store(true);
+    parkCv.wait(lock, ready);
+    parked.store(false);
+}
+
+void SpscRing::wake(std::atomic<bool>& parked) {
+    if (!parked.load()) return;
+    std::lock_guard<std::mutex> lock(parkMutex);
+    parkCv.notify_all();
+}
+
+uint8_t* SpscRing::acquire() {
+    wait([&] { return canceled.load() || tail.load(std::memory_order_relaxed) - head.load() < slots.size(); },
+         producerParked, producerWaits);
+    if (canceled.load()) return nullptr;
+    return slots[tail.load(std::memory_order_relaxed) % slots.size()].data();
+}
+
+void SpscRing::publish(size_t len) {
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    lengths[t % slots.size()] = len;
+    // Only the producer touches these, so plain counters are enough
+    size_t filled = (size_t)(t + 1 - head.load());
+    peak = std::max(peak, filled);
+    occupancySum += filled;
+    tail.store(t + 1);
+    wake(consumerParked);
+}
+
+void SpscRing::close() {
+    closed.store(true);
+    wake(consumerParked);
+}
+
+bool SpscRing::peek(const uint8_t*& data, size_t& len) {
+    wait([&] { return closed.load() || tail.load() != head.load(std::memory_order_relaxed); },
+         consumerParked, consumerWaits);
+    uint64_t h = head.load(std::memory_order_relaxed);
+    if (tail.load() == h) return false; // closed and drained
+    data = slots[h % slots.size()].data();
+    len = lengths[h % slots.size()];
+    return true;
+}
+
+void SpscRing::release() {
+    head.store(head.load(std::memory_order_relaxed) + 1);
+    wake(producerParked);
+}
+
+void SpscRing::cancel() {
+    canceled.store(true);
+    wake(producerParked);
+}
+
+RingStats SpscRing::stats() const {
+    RingStats s;
+    s.slotsPassed = tail.load();
+    s.producerWaits = producerWaits.load();
+    s.consumerWaits = consumerWaits.load();
+    s.parks = parks.load();
+    s.peakOccupancy = peak;
+    s.meanOccupancy = s.slotsPassed ? (double)occupancySum / (double)s.slotsPassed : 0.0;
+    return s;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Occupancy counters of an SpscRing, for benchmarks and tuning the slot count
+struct RingStats {
+    uint64_t slotsPassed = 0;
+    uint64_t producerWaits = 0; // acquire() found the ring full
+    uint64_t consumerWaits = 0; // peek() found the ring empty
+    uint64_t parks = 0;         // waits that outlasted the spin and slept
+    size_t peakOccupancy = 0;
+    double meanOccupancy = 0.0; // filled slots seen at each publish
+};
+
+// Fixed ring of preallocated byte slots passed from exactly one producer thread to exactly
+// one consumer thread. The fast path is two atomic indices; a side that finds the ring
+// full (or empty) spins briefly, then parks on a condition variable until the other side
+// moves, which is what gives the decoder backpressure.
+class SpscRing {
+public:
+    SpscRing(size_t slots, size_t slotSize);
+
+    size_t slotSize() const { return size; }
+
+    // Producer: next free slot, waiting while the ring is full; nullptr once canceled
+    uint8_t* acquire();
+    // Producer: hands the acquired slot, holding `len` bytes, to the consumer
+    void publish(size_t len);
+    // Producer: no more slots; the consumer drains what is left
+    void close();
+
+    // Consumer: oldest filled slot, waiting while the ring is empty; false once closed and drained
+    bool peek(const uint8_t*& data, size_t& len);
+    // Consumer: returns the slot from peek() to the producer
+    void release();
+    // Consumer: stop the producer, e.g. after a write error
+    void cancel();
+
+    RingStats stats() const;
+
+private:
+    template <typename Ready>
+    void wait(Ready ready, std::atomic<bool>& parked, std::atomic<uint64_t>& waits);
+    void wake(std::atomic<bool>& parked);
+
+    size_t size;
+    std::vector<std::vector<uint8_t>> slots;
+    std::vector<size_t> lengths;
+    // Monotonic counters; slot = counter % slots.size()
+    alignas(64) std::atomic<uint64_t> head{0}; // next slot the consumer reads
+    alignas(64) std::atomic<uint64_t> tail{0}; // next slot the producer fills
+    alignas(64) std::atomic<bool> closed{false};
+    std::atomic<bool> canceled{false};
+    std::atomic<bool> producerParked{false};
+    std::atomic<bool> consumerParked{false};
+    std::mutex parkMutex;
+    std::condition_variable parkCv;
+
+    std::atomic<uint64_t> producerWaits{0};
+    std::atomic<uint64_t> consumerWaits{0};
+    std::atomic<uint64_t> parks{0};
+    size_t peak = 0;
+    uint64_t occupancySum = 0;
+};
@@ -0,0 +1,171 @@
+#include "StagedInstall.h"
+#include "InstallManifest.h"
+#include "Trash.h"
+
+#include <chrono>
+#include <unordered_set>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifndef RENAME_EXCHANGE
+#define RENAME_EXCHANGE (1 << 1)
+#endif
+#endif
+
+namespace fs = std::filesystem;
+
+StagedInstall::StagedInstall(const fs::path& target, Durability durability)
+    : target(target), durability(durability) {
+    fs::path clean = target;
+    while (!clean.empty() && !clean.has_filename() && clean.has_relative_path()) {
+        clean = clean.parent_path();
+    }
+    this->target = clean;
+    staging = clean.parent_path() / ("." + clean.filename().string() + ".staging");
+}
+
+bool StagedInstall::replaceable() const {
+    std::error_code ec;
+    if (!fs::exists(target, ec)) return true;
+    if (!fs::is_directory(target, ec)) return false;
+    return fs::is_empty(target, ec) || fs::is_regular_file(target / MIKO_MANIFEST_FILE, ec);
+}
+
+bool StagedInstall::carryOver() {
+    std::error_code ec;
+    if (!fs::exists(target, ec)) return true;
+    InstallManifest previous;
+    previous.load(target / MIKO_MANIFEST_FILE);
+    std::unordered_set<std::string> listed{MIKO_MANIFEST_FILE};
+    for (const auto& f : previous.files()) listed.insert(f.path);
+    std::unordered_set<std::string> touched; // staging directories that gained entries
+
+    fs::recursive_directory_iterator it(target, ec), end;
+    for (; !ec && it != end; it.increment(ec)) {
+        std::string rel = it->path().lexically_relative(target).generic_u8string();
+        std::error_code op;
+        bool link = it->is_symlink(op);
+        // Directories are created only as parents of what is carried, so ones the new
+        // version dropped do not come back empty
+        if (!link && it->is_directory(op)) continue;
+        if (listed.count(rel)) continue;
+        fs::path dest = manifestPath(staging, rel);
+        if (fs::exists(fs::symlink_status(dest, op))) continue; // the new version ships it
+        fs::create_directories(dest.parent_path(), op);
+        op.clear();
+        if (link) {
+            fs::copy_symlink(it->path(), dest, op);
+        } else {
+            fs::create_hard_link(it->path(), dest, op);
+            if (op) {
+                op.clear();
+                fs::copy_file(it->path(), dest, op);
+            }
+        }
+        if (op) return false;
+        // Parents created here are new entries of their own parents
+        for (fs::path dir = dest.parent_path(); dir != staging && dir.has_relative_path(); dir = dir.parent_path()) {
+            if (!touched.insert(dir.u8string()).second) break;
+        }
+        touched.insert(staging.u8string());
+    }
+    if (ec) return false;
+    if (durability == Durability::DirectoryBarriers) {
+        for (const auto& dir : touched) {
+            if (!syncDirectory(fs::u8path(dir))) return false;
+        }
+    }
+    return true;
+}
+
+bool StagedInstall::begin() {
+    std::error_code ec;
+    if (fs::exists(staging, ec)) {
+        // Leftover of a crashed or canceled run: rename it away instead of cleaning it
+        fs::path trashed = Trash::moveToTrash(staging);
+        if (!trashed.empty()) {
+            Trash::spawnReaper(trashed);
+        } else {
+            fs::remove_all(staging, ec);
+        }
+    }
+    ec.clear();
+    fs::create_directories(staging, ec);
+    return !ec;
+}
+
+bool StagedInstall::commit() {
+    barrierSeconds = 0.0;
+    swapDone = false;
+    // Never take a folder the user chose along with the install, nor what they added to it
+    if (!replaceable() || !carryOver()) return false;
+    if (durability == Durability::DirectoryBarriers) {
+        // Files written after extraction (the manifest) are named in the staging root
+        auto barrier = std::chrono::steady_clock::now();
+        if (!syncDirectory(staging)) return false;
+        barrierSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - barrier).count();
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::error_code ec;
+    bool hadTarget = fs::exists(target, ec);
+    bool ok = false;
+    fs::path old;
+
+    if (!hadTarget) {
+        fs::create_directories(target.parent_path(), ec);
+        ec.clear();
+        fs::rename(staging, target, ec);
+        ok = !ec;
+    } else {
+#ifdef __linux__
+        // Atomic exchange: the target path never stops resolving to a complete install
+        if (syscall(SYS_renameat2, AT_FDCWD, staging.c_str(), AT_FDCWD, target.c_str(), RENAME_EXCHANGE) == 0) {
+            old = staging; // now holds the previous install
+            ok = true;
+        }
+#endif
+        if (!ok) {
+            old = Trash::moveToTrash(target);
+            if (!old.empty()) {
+                fs::rename(staging, target, ec);
+                if (ec) {
+                    // Put the previous install back rather than leave the target missing
+                    std::error_code undo;
+                    fs::rename(old, target, undo);
+                    old.clear();
+                } else {
+                    ok = true;
+                }
+            }
+        }
+    }
+    swapSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    swapDone = ok;
+    bool flushed = true;
+    if (ok && durability != Durability::None) {
+        // The renames live in the target's parent; until it is flushed, a crash may undo them
+        auto barrier = std::chrono::steady_clock::now();
+        fs::path parent = target.parent_path();
+        flushed = syncDirectory(parent.empty() ? fs::path(".") : parent);
+        barrierSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - barrier).count();
+    }
+
+    if (ok && old == staging) {
+        old = Trash::moveToTrash(staging);
+    }
+    if (ok && !old.empty()) {
+        Trash::spawnReaper(old);
+    }
+    return ok && flushed;
+}
+
+void StagedInstall::rollback() {
+    fs::path trashed = Trash::moveToTrash(staging);
+    if (!trashed.empty()) {
+        Trash::spawnReaper(trashed);
+    } else {
+        std::error_code ec;
+        fs::remove_all(staging, ec);
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "Durability.h"
+
+#include <filesystem>
+
+// Transactional install: extraction goes into a hidden sibling of the target, and the
+// finished tree replaces the target with renames only. A failed or canceled install never
+// touches the target, and both rollback and the old tree's removal are a rename into the
+// trash (see Trash), independent of the number of files. Only a target that is absent,
+// empty or an earlier install (it holds MIKO_MANIFEST_FILE) is replaced, and files in it
+// that its manifest does not list, such as ones the user added, are carried over.
+class StagedInstall {
+public:
+    // Any durability but None also flushes the swap itself; DirectoryBarriers flushes the
+    // staging root before it (the extractor has flushed everything below it)
+    explicit StagedInstall(const std::filesystem::path& target, Durability durability = Durability::None);
+
+    // Whether commit() may replace the target: it is absent, an empty directory, or an
+    // install with a manifest. Check before extracting; commit() refuses otherwise.
+    bool replaceable() const;
+    // Creates an empty staging directory; a stale one from an interrupted run is trashed
+    bool begin();
+    const std::filesystem::path& stagingPath() const { return staging; }
+    // Puts the staged tree in place of the target. Entries of the previous install that
+    // its manifest does not list and the staged tree lacks are hard-linked into it first;
+    // the previous install is then moved to the trash and reaped in the background. Also false when the swap went
+    // through but could not be flushed (see swapped()): a crash may then still undo it.
+    bool commit();
+    // Whether the last commit() put the staged tree in place, flushed or not
+    bool swapped() const { return swapDone; }
+    // Discards the staged tree
+    void rollback();
+
+    // Wall time of the renames done by the last commit()
+    double lastSwapSeconds() const { return swapSeconds; }
+    // Wall time of the flushes around them
+    double lastBarrierSeconds() const { return barrierSeconds; }
+
+private:
+    // Links what the target's manifest does not list into the staging tree
+    bool carryOver();
+
+    std::filesystem::path target;
+    std::filesystem::path staging;
+    Durability durability;
+    double swapSeconds = 0.0;
+    double barrierSeconds = 0.0;
+    bool swapDone = false;
+};
@@ -0,0 +1,211 @@
+#include "TarStream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+namespace {
+
+uint64_t parseNumber(const uint8_t* field, size_t len) {
+    // GNU base-256 for values that do not fit the octal field
+    if (field[0] & 0x80) {
+        uint64_t v = field[0] & 0x7F;
+        for (size_t i = 1; i < len; ++i) v = (v << 8) | field[i];
+        return v;
+    }
+    uint64_t v = 0;
+    size_t i = 0;
+    while (i < len && (field[i] == ' ' || field[i] == 0)) ++i;
+    for (; i < len && field[i] >= '0' && field[i] <= '7'; ++i) v = (v << 3) | (uint64_t)(field[i] - '0');
+    return v;
+}
+
+// Appends a NUL-padded header field without a temporary string
+void appendField(std::string& out, const uint8_t* field, size_t len) {
+    size_t n = 0;
+    while (n < len && field[n]) ++n;
+    out.append(reinterpret_cast<const char*>(field), n);
+}
+
+} // namespace
+
+bool TarParser::parseHeader() {
+    bool empty = true;
+    for (size_t i = 0; i < sizeof(header); ++i) {
+        if (header[i]) { empty = false; break; }
+    }
+    if (empty) {
+        state = State::End;
+        return true;
+    }
+
+    uint64_t checksum = parseNumber(header + 148, 8);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < sizeof(header); ++i) sum += (i >= 148 && i < 156) ? ' ' : header[i];
+    if (sum != checksum) {
+        state = State::Error;
+        return false;
+    }
+
+    char type = (char)header[156];
+    uint64_t size = parseNumber(header + 124, 12);
+    if (type == 'x' || type == 'L') {
+        extendedType = type;
+        extended.clear();
+        remaining = size;
+        padding = (512 - size % 512) % 512;
+        state = size ? State::Extended : State::Padding;
+        return true;
+    }
+    if (type == 'g') {
+        // Global PAX header: nothing the installer needs, skip its data
+        extendedType = 'g';
+        extended.clear();
+        remaining = size;
+        padding = (512 - size % 512) % 512;
+        state = size ? State::Extended : State::Padding;
+        return true;
+    }
+
+    // Fields are overwritten in place so the path keeps its capacity from entry to entry
+    current.type = type;
+    current.mode = (uint32_t)parseNumber(header + 100, 8);
+    current.size = size;
+    current.path.clear();
+    if (!pendingPath.empty()) {
+        current.path.append(pendingPath);
+    } else if (memcmp(header + 257, "ustar", 5) == 0 && header[345]) {
+        appendField(current.path, header + 345, 155);
+        current.path.push_back('/');
+        appendField(current.path, header, 100);
+    } else {
+        appendField(current.path, header, 100);
+    }
+    if (pendingSize != UINT64_MAX) current.size = pendingSize;
+    pendingPath.clear();
+    pendingSize = UINT64_MAX;
+    while (!current.path.empty() && current.path.back() == '/') {
+        current.path.pop_back();
+        current.type = '5';
+    }
+    if (onEntry && !onEntry(current)) {
+        state = State::Error;
+        return false;
+    }
+    remaining = current.size;
+    padding = (512 - current.size % 512) % 512;
+    if (!remaining) {
+        if (onEntryEnd && !onEntryEnd()) {
+            state = State::Error;
+            return false;
+        }
+        state = padding ? State::Padding : State::Header;
+    } else {
+        state = State::Data;
+    }
+    return true;
+}
+
+void TarParser::applyPax(const std::string& records) {
+    // Records are "<len> <key>=<value>\n", len counting the whole record
+    size_t off = 0;
+    while (off < records.size()) {
+        size_t space = records.find(' ', off);
+        if (space == std::string::npos) break;
+        size_t len = (size_t)strtoull(records.c_str() + off, nullptr, 10);
+        if (len == 0 || off + len > records.size()) break;
+        size_t eq = records.find('=', space);
+        if (eq != std::string::npos && eq < off + len) {
+            std::string_view all(records);
+            std::string_view key = all.substr(space + 1, eq - space - 1);
+            std::string_view value = all.substr(eq + 1, off + len - eq - 2);
+            if (key == "path") pendingPath.assign(value.data(), value.size());
+            else if (key == "size") pendingSize = strtoull(value.data(), nullptr, 10);
+        }
+        off += len;
+    }
+}
+
+uint64_t TarParser::bytesBeforeData() const {
+    switch (state) {
+    case State::Header: return sizeof(header) - headerFill;
+    case State::Data:
+    case State::Extended: return remaining + padding + sizeof(header);
+    case State::Padding: return padding + sizeof(header);
+    default: return UINT64_MAX;
+    }
+}
+
+bool TarParser::skipData(uint64_t len) {
+    if (state != State::Data || len > remaining) {
+        state = State::Error;
+        return false;
+    }
+    remaining -= len;
+    if (!remaining) {
+        if (onEntryEnd && !onEntryEnd()) {
+            state = State::Error;
+            return false;
+        }
+        state = padding ? State::Padding : State::Header;
+    }
+    return true;
+}
+
+bool TarParser::feed(const uint8_t* data, size_t len) {
+    while (len) {
+        switch (state) {
+        case State::Header: {
+            size_t take = std::min(len, sizeof(header) - headerFill);
+            memcpy(header + headerFill, data, take);
+            headerFill += take; data += take; len -= take;
+            if (headerFill == sizeof(header)) {
+                headerFill = 0;
+                if (!parseHeader()) return false;
+            }
+            break;
+        }
+        case State::Data: {
+            size_t take = (size_t)std::min<uint64_t>(len, remaining);
+            if (onData && !onData(data, take)) {
+                state = State::Error;
+                return false;
+            }
+            data += take; len -= take; remaining -= take;
+            if (!remaining) {
+                if (onEntryEnd && !onEntryEnd()) {
+                    state = State::Error;
+                    return false;
+                }
+                state = padding ? State::Padding : State::Header;
+            }
+            break;
+        }
+        case State::Extended: {
+            size_t take = (size_t)std::min<uint64_t>(len, remaining);
+            if (extendedType != 'g') extended.append(reinterpret_cast<const char*>(data), take);
+            data += take; len -= take; remaining -= take;
+            if (!remaining) {
+                if (extendedType == 'x') {
+                    applyPax(extended);
+                } else if (extendedType == 'L') {
+                    pendingPath.assign(extended.c_str()); // NUL terminated
+                }
+                state = padding ? State::Padding : State::Header;
+            }
+            break;
+        }
+        case State::Padding: {
+            size_t take = (size_t)std::min<uint64_t>(len, padding);
+            data += take; len -= take; padding -= take;
+            if (!padding) state = State::Header;
+            break;
+        }
+        case State::End:
+            return true; // trailing zero blocks and slack after the marker
+        case State::Error:
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+
+struct TarEntry {
+    std::string path; // as stored, '/' separated; directories keep no trailing slash
+    uint64_t size = 0;
+    char type = '0';
+    uint32_t mode = 0644;
+
+    bool isDirectory() const { return type == '5'; }
+    bool isFile() const { return type == '0' || type == '\0' || type == '7'; }
+};
+
+// Incremental TAR reader: feed() accepts the archive in arbitrary slices, so decoding and
+// extraction never need the whole archive in memory. Understands ustar prefixes, PAX
+// extended headers (path/size) and GNU long names as written by Python's tarfile.
+class TarParser {
+public:
+    // Return false from any callback to abort parsing
+    std::function<bool(const TarEntry&)> onEntry;
+    std::function<bool(const uint8_t* data, size_t len)> onData;
+    std::function<bool()> onEntryEnd;
+
+    bool feed(const uint8_t* data, size_t len);
+    // True once the end-of-archive marker was seen
+    bool finished() const { return state == State::End; }
+    bool failed() const { return state == State::Error; }
+    // True when the input so far ended exactly after an entry (or the end marker)
+    bool betweenEntries() const { return (state == State::Header && headerFill == 0) || state == State::End; }
+
+    // Data bytes of the current entry not yet fed; 0 outside an entry's data
+    uint64_t dataRemaining() const { return state == State::Data ? remaining : 0; }
+    // Input feed() needs before it is at the start of an entry's data again: the rest of
+    // this header, extended header, data or padding, plus the next header. Lets a caller
+    // stop reading exactly where a body begins; UINT64_MAX once nothing more is parsed.
+    uint64_t bytesBeforeData() const;
+    // Consumes `len` <= dataRemaining() bytes of the current entry that the caller handled
+    // itself, without onData; ends the entry (onEntryEnd) when they were the last
+    bool skipData(uint64_t len);
+
+private:
+    enum class State { Header, Data, Extended, Padding, End, Error };
+
+    bool parseHeader();
+    void applyPax(const std::string& records);
+
+    State state = State::Header;
+    uint8_t header[512];
+    size_t headerFill = 0;
+    uint64_t remaining = 0;  // data bytes left in the current entry
+    uint64_t padding = 0;    // bytes up to the next 512-byte boundary
+    char extendedType = 0;   // 'x' or 'L' while collecting an extended header
+    std::string extended;
+    std::string pendingPath; // overrides carried from an extended header to the next entry
+    uint64_t pendingSize = UINT64_MAX;
+    TarEntry current;
+};
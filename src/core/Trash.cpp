@@ -0,0 +1,176 @@
+#include "Trash.h"
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+static const char MIKO_TRASH_DIR[] = ".miko-trash";
+
+fs::path Trash::rootFor(const fs::path& target) {
+    fs::path clean = target;
+    while (!clean.empty() && !clean.has_filename() && clean.has_relative_path()) {
+        clean = clean.parent_path(); // tolerate a trailing separator
+    }
+    return clean.parent_path() / MIKO_TRASH_DIR;
+}
+
+fs::path Trash::moveToTrash(const fs::path& target) {
+    std::error_code ec;
+    if (!fs::exists(target, ec)) return {};
+    fs::path root = rootFor(target);
+#ifdef _WIN32
+    unsigned long pid = GetCurrentProcessId();
+#else
+    unsigned long pid = (unsigned long)getpid();
+#endif
+    auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+    fs::path run = root / (target.filename().string() + "." + std::to_string(pid) + "." + std::to_string(stamp));
+    fs::create_directories(run, ec);
+    if (ec) return {};
+#ifdef _WIN32
+    SetFileAttributesW(root.c_str(), FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_DIRECTORY);
+#endif
+    fs::path dest = run / target.filename();
+    fs::rename(target, dest, ec);
+    if (ec) {
+        std::error_code ignored;
+        fs::remove(run, ignored);
+        return {};
+    }
+    return dest;
+}
+
+static const char MIKO_REAPER_MARKER[] = ".reaping";
+
+// "<run>.reaping", next to the run in the trash root. It marks a run a reaper is working on:
+// on POSIX the reaper holds a lock on it, on Windows it holds the reaper's process id
+static fs::path markerFor(const fs::path& run) {
+    fs::path marker = run;
+    marker += MIKO_REAPER_MARKER;
+    return marker;
+}
+
+// True while the reaper that wrote `marker` is still running
+static bool reaperAlive(const fs::path& marker) {
+#ifdef _WIN32
+    unsigned long pid = 0;
+    std::ifstream in(marker);
+    if (!(in >> pid) || !pid) return false;
+    HANDLE h = OpenProcess(SYNCHRONIZE, FALSE, (DWORD)pid);
+    if (!h) return false;
+    bool alive = WaitForSingleObject(h, 0) == WAIT_TIMEOUT;
+    CloseHandle(h);
+    return alive;
+#else
+    int fd = open(marker.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool alive = flock(fd, LOCK_EX | LOCK_NB) != 0 && errno == EWOULDBLOCK;
+    close(fd);
+    return alive;
+#endif
+}
+
+// Deletes one run directory in the background, then its trash root unless another run is
+// still in there
+static bool reap(const fs::path& run) {
+    fs::path root = run.parent_path();
+    fs::path marker = markerFor(run);
+#ifdef _WIN32
+    // The short delay lets the process that trashed the tree exit first, in case its own
+    // files moved along with it. ping, not timeout: timeout refuses to run without a console
+    std::wstring cmd = L"cmd.exe /c ping -n 3 127.0.0.1 >nul & rmdir /s /q \"" + run.wstring() +
+                       L"\" & del /q \"" + marker.wstring() + L"\" & rmdir \"" + root.wstring() + L"\" 2>nul";
+    STARTUPINFOW si{}; PROCESS_INFORMATION pi{};
+    si.cb = sizeof(si);
+    DWORD flags = CREATE_NO_WINDOW | IDLE_PRIORITY_CLASS;
+    BOOL ok = CreateProcessW(nullptr, cmd.data(), nullptr, nullptr, FALSE, flags | CREATE_BREAKAWAY_FROM_JOB,
+                             nullptr, nullptr, &si, &pi);
+    if (!ok) {
+        // Jobs that forbid breakaway: the reaper then lives as long as the job does
+        ok = CreateProcessW(nullptr, cmd.data(), nullptr, nullptr, FALSE, flags, nullptr, nullptr, &si, &pi);
+    }
+    if (!ok) return false;
+    // Written well within the reaper's initial delay, so it is there before the reaper deletes it
+    std::ofstream(marker) << pi.dwProcessId;
+    CloseHandle(pi.hThread);
+    CloseHandle(pi.hProcess);
+    return true;
+#else
+    // Everything the children need is prepared before fork; they only make syscalls and exec
+    std::string runPath = run.string();
+    std::string rootPath = root.string();
+    std::string markerPath = marker.string();
+    pid_t child = fork();
+    if (child < 0) return false;
+    if (child == 0) {
+        // Locked before this child exits, so the run is marked by the time spawnReaper returns;
+        // the reaper below inherits the descriptor and with it the lock
+        int lock = open(markerPath.c_str(), O_CREAT | O_RDWR, 0644);
+        if (lock >= 0) flock(lock, LOCK_EX);
+        setsid();
+        setpriority(PRIO_PROCESS, 0, 19);
+#if defined(__linux__) && defined(SYS_ioprio_set)
+        // IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT, for the calling process
+        syscall(SYS_ioprio_set, 1, 0, 3 << 13);
+#endif
+        if (fork() == 0) {
+            int devnull = open("/dev/null", O_RDWR);
+            if (devnull >= 0) {
+                dup2(devnull, 0); dup2(devnull, 1); dup2(devnull, 2);
+            }
+            pid_t rm = fork();
+            if (rm == 0) {
+                execlp("rm", "rm", "-rf", "--", runPath.c_str(), (char*)nullptr);
+                _exit(127);
+            }
+            if (rm > 0) {
+                int status = 0;
+                waitpid(rm, &status, 0);
+            }
+            unlink(markerPath.c_str());
+            rmdir(rootPath.c_str()); // fails while other runs are in the trash
+        }
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    return true;
+#endif
+}
+
+bool Trash::spawnReaper(const fs::path& trashed) {
+    return reap(trashed.parent_path());
+}
+
+void Trash::sweepLeftovers(const fs::path& target) {
+    fs::path root = rootFor(target);
+    std::error_code ec;
+    if (!fs::is_directory(root, ec)) return;
+    for (const fs::directory_entry& entry : fs::directory_iterator(root, ec)) {
+        const fs::path& p = entry.path();
+        std::error_code ignored;
+        if (p.extension() == MIKO_REAPER_MARKER) {
+            // A marker whose run is gone belongs to a reaper that died before removing it
+            fs::path run = p;
+            run.replace_extension();
+            if (!fs::exists(run, ignored) && !reaperAlive(p)) fs::remove(p, ignored);
+            continue;
+        }
+        if (reaperAlive(markerFor(p))) continue; // still being deleted
+        reap(p);
+    }
+    fs::remove(root, ec); // only when it was empty already
+}
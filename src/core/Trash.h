@@ -0,0 +1,23 @@
+#pragma once
+#include <filesystem>
+
+// Makes large trees disappear instantly: one rename moves the tree into a hidden trash
+// folder next to it (same volume, so the rename is atomic), and a detached low-priority
+// process deletes it from there. Each move gets a run directory of its own in the trash,
+// and a reaper only deletes its run, so it cannot take a tree another process is moving
+// in at the same time. Leftovers of a reaper that died midway are swept by the next
+// installer or uninstaller run.
+class Trash {
+public:
+    // "<parent of target>/.miko-trash"
+    static std::filesystem::path rootFor(const std::filesystem::path& target);
+    // Renames target into a new run directory in the trash; returns its new location, or an
+    // empty path when the rename is not possible (files in use, different volume, permissions)
+    static std::filesystem::path moveToTrash(const std::filesystem::path& target);
+    // Starts a detached, idle-priority process that deletes the run directory holding
+    // `trashed` (a path moveToTrash() returned), then the trash root if that is left empty
+    static bool spawnReaper(const std::filesystem::path& trashed);
+    // Restarts a reaper for every run a previous process left in the trash next to target;
+    // runs whose reaper is still alive are left to it
+    static void sweepLeftovers(const std::filesystem::path& target);
+};
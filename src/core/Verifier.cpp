@@ -0,0 +1,114 @@
+#include "Verifier.h"
+#include "Extractor.h"
+#include "InstallManifest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+const char* verifyIssueName(VerifyIssue::Kind kind) {
+    switch (kind) {
+    case VerifyIssue::Missing: return "missing";
+    case VerifyIssue::SizeMismatch: return "size mismatch";
+    case VerifyIssue::HashMismatch: return "content mismatch";
+    }
+    return "damaged";
+}
+
+Verifier::Verifier(unsigned threads, BufferPool* buffers)
+    : threads(threads ? threads : std::max(1u, std::thread::hardware_concurrency())), buffers(buffers) {}
+
+VerifyReport Verifier::verify(const fs::path& root, const std::vector<PayloadFileHash>& expected) {
+    VerifyReport report;
+    auto start = std::chrono::steady_clock::now();
+    done = 0;
+
+    // Largest first, so one big runtime does not end up last on a single worker
+    std::vector<size_t> order(expected.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return expected[a].size > expected[b].size; });
+
+    std::atomic<size_t> next{0};
+    std::atomic<uint64_t> hashed{0};
+    std::mutex issuesMutex;
+    BufferPool local(1 << 20);
+    BufferPool& hashBuffers = buffers ? *buffers : local;
+    auto work = [&]() {
+        BufferPool::Buffer buf = hashBuffers.acquire();
+        for (;;) {
+            size_t k = next.fetch_add(1);
+            if (k >= order.size()) return;
+            const PayloadFileHash& want = expected[order[k]];
+            fs::path p = manifestPath(root, want.path);
+            std::error_code ec;
+            uint64_t size = fs::file_size(p, ec);
+            VerifyIssue::Kind kind = VerifyIssue::Missing;
+            bool bad = true;
+            if (ec) {
+                kind = VerifyIssue::Missing;
+            } else if (size != want.size) {
+                // Size alone settles it, no need to read the file
+                kind = VerifyIssue::SizeMismatch;
+            } else {
+                std::ifstream f(p, std::ios::binary);
+                Sha256 sha;
+                while (f) {
+                    f.read(reinterpret_cast<char*>(buf.data()), (std::streamsize)buf.size());
+                    std::streamsize n = f.gcount();
+                    if (n <= 0) break;
+                    sha.update(buf.data(), (size_t)n);
+                    hashed.fetch_add((uint64_t)n, std::memory_order_relaxed);
+                }
+                uint8_t digest[Sha256::DIGEST_SIZE];
+                sha.final(digest);
+                kind = VerifyIssue::HashMismatch;
+                bad = f.bad() || memcmp(digest, want.sha256, sizeof(digest)) != 0;
+            }
+            if (bad) {
+                std::lock_guard<std::mutex> lock(issuesMutex);
+                report.issues.push_back({want.path, kind});
+            }
+            done.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+    std::vector<std::thread> pool;
+    unsigned n = (unsigned)std::min<size_t>(threads, std::max<size_t>(1, expected.size()));
+    for (unsigned t = 1; t < n; ++t) pool.emplace_back(work);
+    work();
+    for (auto& th : pool) th.join();
+
+    std::sort(report.issues.begin(), report.issues.end(),
+              [](const VerifyIssue& a, const VerifyIssue& b) { return a.path < b.path; });
+    report.filesChecked = expected.size();
+    report.bytesHashed = hashed.load();
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return report;
+}
+
+bool Verifier::repair(const PayloadReader& payload, const fs::path& root, const VerifyReport& report,
+                      std::string* error, Durability durability) {
+    if (report.clean()) return true;
+    std::unordered_set<std::string> damaged;
+    for (const auto& issue : report.issues) damaged.insert(issue.path);
+
+    ExtractOptions opts;
+    opts.only = &damaged;
+    opts.replaceExisting = true;
+    opts.buffers = buffers;
+    opts.durability = durability;
+    Extractor extractor(payload, root);
+    bool ok = extractor.run(opts);
+    if (ok && extractor.filesWritten() < damaged.size()) {
+        ok = false;
+        if (error) *error = "payload does not contain every damaged file";
+    } else if (!ok && error) {
+        *error = extractor.error();
+    }
+    return ok;
+}
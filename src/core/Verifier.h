@@ -0,0 +1,48 @@
+#pragma once
+#include "BufferPool.h"
+#include "Durability.h"
+#include "Payload.h"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+struct VerifyIssue {
+    enum Kind { Missing, SizeMismatch, HashMismatch };
+    std::string path;
+    Kind kind;
+};
+
+struct VerifyReport {
+    uint64_t filesChecked = 0;
+    uint64_t bytesHashed = 0;
+    double seconds = 0.0;
+    std::vector<VerifyIssue> issues;
+    bool clean() const { return issues.empty(); }
+};
+
+// Checks an installed tree against the payload's HASH section with one hashing worker per
+// core, and rewrites only the files that came out damaged or missing.
+class Verifier {
+public:
+    // Hash and repair buffers come from `buffers` when given, else from a private pool
+    explicit Verifier(unsigned threads = 0, BufferPool* buffers = nullptr);
+
+    VerifyReport verify(const std::filesystem::path& root, const std::vector<PayloadFileHash>& expected);
+    // Decodes the payload once and writes back only the entries named in the report,
+    // flushing them as `durability` asks
+    bool repair(const PayloadReader& payload, const std::filesystem::path& root, const VerifyReport& report,
+                std::string* error = nullptr, Durability durability = Durability::None);
+
+    // Files hashed so far by the running verify(); for progress reporting
+    uint64_t filesDone() const { return done.load(); }
+
+private:
+    unsigned threads;
+    BufferPool* buffers;
+    std::atomic<uint64_t> done{0};
+};
+
+const char* verifyIssueName(VerifyIssue::Kind kind);
@@ -0,0 +1,39 @@
+#include "WorkStealingQueue.h"
+
+#include <algorithm>
+
+WorkStealingQueue::WorkStealingQueue(unsigned workers) {
+    for (unsigned i = 0; i < std::max(1u, workers); ++i) lanes.push_back(std::make_unique<Lane>());
+}
+
+void WorkStealingQueue::deal(const std::vector<size_t>& tasks) {
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        Lane& lane = *lanes[i % lanes.size()];
+        std::lock_guard<std::mutex> lock(lane.mutex);
+        lane.tasks.push_back(tasks[i]);
+    }
+}
+
+bool WorkStealingQueue::take(unsigned worker, size_t& task) {
+    {
+        Lane& own = *lanes[worker % lanes.size()];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+    // Tasks are never added once dealt, so one pass over the other lanes is conclusive
+    for (size_t i = 1; i < lanes.size(); ++i) {
+        Lane& victim = *lanes[(worker + i) % lanes.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            stolen.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
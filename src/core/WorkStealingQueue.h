@@ -0,0 +1,31 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Task indices spread over one deque per worker. A worker takes from the front of its own
+// deque and, once that is empty, steals from the back of the others', so tasks dealt
+// largest-first stay balanced even when their sizes differ by orders of magnitude.
+class WorkStealingQueue {
+public:
+    explicit WorkStealingQueue(unsigned workers);
+
+    // Deals tasks round-robin in the given order; callers pass them largest first
+    void deal(const std::vector<size_t>& tasks);
+    // Next task for `worker`; false once every deque is empty
+    bool take(unsigned worker, size_t& task);
+
+    uint64_t steals() const { return stolen.load(); }
+
+private:
+    struct Lane {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+    std::vector<std::unique_ptr<Lane>> lanes;
+    std::atomic<uint64_t> stolen{0};
+};
@@ -0,0 +1,383 @@
+#include "WriteBackend.h"
+#include "OutputFile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if defined(__NR_io_uring_setup) && defined(IORING_FEAT_CQE_SKIP)
+#define MIKO_HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+namespace {
+
+// Jobs this large reserve their extent before the write
+const size_t FALLOCATE_MIN = 64 * 1024;
+// Largest file a batch takes, at most a quarter of a batch buffer
+const size_t SMALL_FILE_MAX = 256 * 1024;
+const unsigned WRITER_THREADS = 4;
+
+// Whole files written by a few threads per lane, each through its own OutputFile without a
+// buffer, as the job already holds the whole file
+class ThreadBackend : public WriteBackend {
+public:
+    ThreadBackend(ExtractIoStats& stats, bool syncEach) : syncEach(syncEach) {
+        for (unsigned i = 0; i < WRITER_THREADS; ++i) workers.emplace_back([this, &stats] { work(stats); });
+    }
+
+    ~ThreadBackend() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t : workers) t.join();
+    }
+
+    void submit(const WriteJob* batch, size_t count) override {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs = batch;
+            total = count;
+            next = 0;
+            done = 0;
+        }
+        wake.notify_all();
+    }
+
+    bool wait() override {
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&] { return done == total; });
+        jobs = nullptr;
+        total = 0;
+        return failed.empty();
+    }
+
+    WriteBackendKind kind() const override { return WriteBackendKind::Threads; }
+
+private:
+    void work(ExtractIoStats& stats) {
+        OutputFile out(stats);
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            wake.wait(lock, [&] { return stopping || next < total; });
+            if (stopping) return;
+            const WriteJob& job = jobs[next++];
+            lock.unlock();
+            bool ok = out.open(job.dirFd, job.name, job.path);
+            if (ok && job.size >= FALLOCATE_MIN) out.preallocate(job.size);
+            ok = ok && out.write(job.data, job.size);
+            if (syncEach) ok = ok && out.sync();
+            ok = out.close() && ok;
+            lock.lock();
+            if (!ok && failed.empty()) failed = job.path;
+            if (++done == total) finished.notify_all();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    std::vector<std::thread> workers;
+    const WriteJob* jobs = nullptr;
+    size_t total = 0, next = 0, done = 0;
+    bool stopping = false;
+    bool syncEach;
+};
+
+#ifdef MIKO_HAVE_IO_URING
+
+// A raw io_uring (no liburing). Each job becomes one linked chain on a direct descriptor:
+// openat into table slot i, fallocate for larger files, write, fdatasync when asked, close.
+// A failed open cancels the rest of its chain. Once the open succeeded, the write and sync
+// are hard links, so a failed or short write still reaches the close and the slot is
+// released for the next batch; nothing waits for the kernel between the steps of one file, and a batch costs one
+// io_uring_enter().
+class UringBackend : public WriteBackend {
+public:
+    UringBackend(ExtractIoStats& stats, size_t depth, bool syncEach)
+        : stats(stats), depth(depth), syncEach(syncEach) {}
+
+    ~UringBackend() override {
+        if (sqes != MAP_FAILED) munmap(sqes, sqesLen);
+        if (rings != MAP_FAILED) munmap(rings, ringsLen);
+        if (ring >= 0) ::close(ring);
+    }
+
+    bool init() {
+        unsigned entries = 1;
+        while (entries < depth * 5) entries <<= 1;
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        ring = (int)syscall(__NR_io_uring_setup, entries, &p);
+        if (ring < 0) return false;
+        // Direct-descriptor openat and close arrived in 5.15; CQE_SKIP (5.17) stands in for
+        // the version check, as the kernel has no feature bit for them
+        if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_CQE_SKIP)) return false;
+        ringsLen = std::max<size_t>(p.sq_off.array + p.sq_entries * sizeof(unsigned),
+                                    p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe));
+        rings = mmap(nullptr, ringsLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+        if (rings == MAP_FAILED) return false;
+        sqesLen = p.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(
+            mmap(nullptr, sqesLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED) return false;
+        char* base = static_cast<char*>(rings);
+        sqTail = reinterpret_cast<unsigned*>(base + p.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(base + p.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(base + p.sq_off.array);
+        cqHead = reinterpret_cast<unsigned*>(base + p.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(base + p.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(base + p.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(base + p.cq_off.cqes);
+        // An empty table of direct descriptors, one slot per job of a batch
+        std::vector<int> empty(depth, -1);
+        return syscall(__NR_io_uring_register, ring, IORING_REGISTER_FILES, empty.data(), (unsigned)depth) == 0;
+    }
+
+    void submit(const WriteJob* batch, size_t count) override {
+        jobs = batch;
+        unsigned queued = 0;
+        for (size_t i = 0; i < count; ++i) {
+            const WriteJob& job = batch[i];
+            io_uring_sqe* sqe = push(queued, i, OP_OPEN);
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = job.dirFd >= 0 ? job.dirFd : AT_FDCWD;
+            sqe->addr = reinterpret_cast<uintptr_t>(job.dirFd >= 0 ? job.name : job.path);
+            sqe->len = 0666;
+            sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC; // O_CLOEXEC is refused for direct descriptors
+            sqe->file_index = (uint32_t)i + 1;
+            sqe->flags = IOSQE_IO_LINK;
+            if (job.size >= FALLOCATE_MIN) {
+                sqe = push(queued, i, OP_FALLOCATE);
+                sqe->opcode = IORING_OP_FALLOCATE;
+                sqe->fd = (int)i;
+                sqe->addr = job.size;
+                sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK; // only a hint
+            }
+            if (job.size) {
+                sqe = push(queued, i, OP_WRITE);
+                sqe->opcode = IORING_OP_WRITE;
+                sqe->fd = (int)i;
+                sqe->addr = reinterpret_cast<uintptr_t>(job.data);
+                sqe->len = (uint32_t)job.size;
+                sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+                stats.writes.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (syncEach) {
+                sqe = push(queued, i, OP_SYNC);
+                sqe->opcode = IORING_OP_FSYNC;
+                sqe->fd = (int)i;
+                sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+                sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+                stats.syncs.fetch_add(1, std::memory_order_relaxed);
+            }
+            sqe = push(queued, i, OP_CLOSE);
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->file_index = (uint32_t)i + 1;
+        }
+        stats.fileOpens.fetch_add(count, std::memory_order_relaxed);
+        stats.closes.fetch_add(count, std::memory_order_relaxed);
+        __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+        pending += queued;
+        while (queued) {
+            long n = syscall(__NR_io_uring_enter, ring, queued, 0, 0, nullptr, 0);
+            stats.submits.fetch_add(1, std::memory_order_relaxed);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                failed = "io_uring_enter failed";
+                pending -= queued;
+                // Take the unsubmitted entries back out of the ring, or the next submit would
+                // hand the kernel them too, pointing at this batch's buffers
+                tail -= queued;
+                __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+                break;
+            }
+            queued -= (unsigned)n;
+        }
+    }
+
+    bool wait() override {
+        while (pending) {
+            unsigned head = *cqHead;
+            unsigned tailNow = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            if (head == tailNow) {
+                // One sleep for the whole batch rather than a wakeup per completion
+                long n = syscall(__NR_io_uring_enter, ring, 0, pending, IORING_ENTER_GETEVENTS, nullptr, 0);
+                stats.submits.fetch_add(1, std::memory_order_relaxed);
+                if (n < 0 && errno != EINTR) {
+                    if (failed.empty()) failed = "io_uring_enter failed";
+                    break;
+                }
+                continue;
+            }
+            for (; head != tailNow; ++head, --pending) {
+                const io_uring_cqe& cqe = cqes[head & cqMask];
+                size_t job = (size_t)(cqe.user_data >> 3);
+                unsigned op = (unsigned)(cqe.user_data & 7);
+                // Canceled steps follow a failure reported by their own chain
+                bool bad = cqe.res < 0 && cqe.res != -ECANCELED && op != OP_FALLOCATE;
+                if (op == OP_WRITE && cqe.res >= 0 && (size_t)cqe.res != jobs[job].size) bad = true;
+                if (bad && failed.empty()) failed = jobs[job].path;
+            }
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        }
+        jobs = nullptr;
+        return failed.empty();
+    }
+
+    WriteBackendKind kind() const override { return WriteBackendKind::IoUring; }
+
+private:
+    enum { OP_OPEN, OP_FALLOCATE, OP_WRITE, OP_SYNC, OP_CLOSE };
+
+    io_uring_sqe* push(unsigned& queued, size_t job, unsigned op) {
+        unsigned index = tail & sqMask;
+        io_uring_sqe* sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->user_data = ((uint64_t)job << 3) | op;
+        sqArray[index] = index;
+        ++tail;
+        ++queued;
+        return sqe;
+    }
+
+    ExtractIoStats& stats;
+    size_t depth;
+    bool syncEach;
+    int ring = -1;
+    void* rings = MAP_FAILED;
+    size_t ringsLen = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqesLen = 0;
+    unsigned* sqTail = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+    unsigned tail = 0;    // our copy of the submission tail
+    unsigned pending = 0; // completions still to reap
+    const WriteJob* jobs = nullptr;
+};
+
+#endif
+
+} // namespace
+
+const char* writeBackendName(WriteBackendKind kind) {
+    switch (kind) {
+    case WriteBackendKind::Direct: return "direct";
+    case WriteBackendKind::IoUring: return "io_uring";
+    case WriteBackendKind::Threads: return "threads";
+    case WriteBackendKind::Auto: return "auto";
+    }
+    return "?";
+}
+
+std::unique_ptr<WriteBackend> WriteBackend::create(WriteBackendKind kind, ExtractIoStats& stats, size_t depth,
+                                                   bool syncEach) {
+    if (kind == WriteBackendKind::Direct) return nullptr;
+#ifdef MIKO_HAVE_IO_URING
+    if (kind == WriteBackendKind::IoUring) {
+        auto uring = std::make_unique<UringBackend>(stats, depth, syncEach);
+        // Kernels without io_uring, or with it disabled by policy (seccomp, sysctl), fall back
+        if (uring->init()) return uring;
+    }
+#else
+    (void)depth;
+#endif
+    return std::make_unique<ThreadBackend>(stats, syncEach);
+}
+
+SmallFileBatcher::SmallFileBatcher(WriteBackend& backend, BufferPool& buffers, DirTable::Handles& handles,
+                                   size_t depth)
+    : backend(backend), handles(handles), depth(depth) {
+    for (Batch& b : batches) {
+        b.data = buffers.acquire();
+        b.jobs.reserve(depth);
+    }
+    handles.deferCloses(true);
+}
+
+SmallFileBatcher::~SmallFileBatcher() {
+    finish();
+    handles.deferCloses(false);
+}
+
+size_t SmallFileBatcher::maxFileSize() const {
+    return std::min(SMALL_FILE_MAX, std::min(batches[0].data.size(), batches[1].data.size()) / 4);
+}
+
+bool SmallFileBatcher::add(int dirFd, std::string_view name, std::string_view path, size_t size) {
+    Batch* b = &batches[current];
+    if (b->jobs.size() == depth || b->data.size() - b->fill < size) {
+        if (!flush()) return false;
+        b = &batches[current];
+    }
+    WriteJob job;
+    job.dirFd = dirFd;
+    job.name = b->names.join(name).data();
+    job.path = b->names.join(path).data();
+    job.data = b->data.data() + b->fill;
+    b->jobs.push_back(job);
+    expected = size;
+    return true;
+}
+
+bool SmallFileBatcher::append(const uint8_t* data, size_t len) {
+    if (len > expected) return false;
+    Batch& b = batches[current];
+    memcpy(b.data.data() + b.fill, data, len);
+    b.fill += len;
+    b.jobs.back().size += len;
+    expected -= len;
+    return true;
+}
+
+void SmallFileBatcher::dropLast() {
+    Batch& b = batches[current];
+    if (b.jobs.empty()) return;
+    b.fill -= b.jobs.back().size;
+    b.jobs.pop_back();
+    expected = 0;
+}
+
+bool SmallFileBatcher::flush() {
+    Batch& b = batches[current];
+    if (b.jobs.empty()) return true;
+    bool ok = true;
+    if (inFlight) ok = backend.wait();
+    backend.submit(b.jobs.data(), b.jobs.size());
+    inFlight = true;
+    handles.endGeneration();
+    // The other batch has landed; it fills next
+    current ^= 1;
+    Batch& next = batches[current];
+    next.jobs.clear();
+    next.fill = 0;
+    next.names.reset();
+    return ok;
+}
+
+bool SmallFileBatcher::finish() {
+    bool ok = flush();
+    if (inFlight) ok = backend.wait() && ok;
+    inFlight = false;
+    handles.endGeneration();
+    handles.endGeneration();
+    return ok;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "Arena.h"
+#include "BufferPool.h"
+#include "DirTable.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// One small file handed to a WriteBackend whole
+struct WriteJob {
+    int dirFd = -1;             // parent handle, or -1 to open `path`
+    const char* name = nullptr; // within dirFd, NUL-terminated
+    const char* path = nullptr; // full path, NUL-terminated
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+enum class WriteBackendKind {
+    Direct,  // each file opened, written and closed in turn by the extracting thread
+    IoUring, // Linux: batches submitted to an io_uring as linked open/write/close chains
+    Threads, // a few threads per extraction lane, each writing whole files
+    Auto,    // Threads, which measured fastest in `miko_bench write`; io_uring is opt-in
+};
+
+const char* writeBackendName(WriteBackendKind kind);
+
+// Writes batches of small files asynchronously: the extractor decodes the next batch while
+// the backend creates and fills the files of the previous one. One batch is in flight at a
+// time, so batches land in TAR order.
+class WriteBackend {
+public:
+    virtual ~WriteBackend() = default;
+
+    // Starts writing jobs[0, count); they, their names and data must stay valid until wait()
+    virtual void submit(const WriteJob* jobs, size_t count) = 0;
+    // Completes the submitted batch; false when any file failed (see error())
+    virtual bool wait() = 0;
+    virtual WriteBackendKind kind() const = 0;
+    const std::string& error() const { return failed; }
+
+    // nullptr for Direct. IoUring falls back to Threads when io_uring is unavailable; `depth` is the
+    // most jobs one batch may hold. With `syncEach`, every file is flushed to stable storage
+    // before it is closed.
+    static std::unique_ptr<WriteBackend> create(WriteBackendKind kind, ExtractIoStats& stats, size_t depth,
+                                                bool syncEach = false);
+
+protected:
+    std::string failed;
+};
+
+// Gathers whole small files into two pooled buffers for a WriteBackend: one fills while the
+// other is being written. Directory handles named by queued jobs are kept open until the
+// batch using them has landed.
+class SmallFileBatcher {
+public:
+    SmallFileBatcher(WriteBackend& backend, BufferPool& buffers, DirTable::Handles& handles, size_t depth);
+    ~SmallFileBatcher();
+
+    // Largest file a batch takes
+    size_t maxFileSize() const;
+    // Queues a file of `size` bytes whose data follows through append(); names are copied.
+    // False when handing off a full batch revealed a failed write.
+    bool add(int dirFd, std::string_view name, std::string_view path, size_t size);
+    // False when the data overruns the size given to add()
+    bool append(const uint8_t* data, size_t len);
+    // Forgets the file being added, e.g. when extraction stopped in the middle of it
+    void dropLast();
+    // Hands off the current batch, then waits until everything has landed
+    bool finish();
+    const std::string& error() const { return backend.error(); }
+
+private:
+    struct Batch {
+        BufferPool::Buffer data;
+        size_t fill = 0;
+        std::vector<WriteJob> jobs;
+        Arena names{16 * 1024};
+    };
+    bool flush();
+
+    WriteBackend& backend;
+    DirTable::Handles& handles;
+    size_t depth;
+    Batch batches[2];
+    unsigned current = 0;
+    size_t expected = 0; // bytes still to come for the last job
+    bool inFlight = false;
+};
@@ -20,6 +20,8 @@ NK_API void                 nk_sdl_font_stash_begin(struct nk_font_atlas **atlas
 NK_API void                 nk_sdl_font_stash_end(void);
 NK_API int                  nk_sdl_handle_event(SDL_Event *evt);
 NK_API void                 nk_sdl_render(enum nk_anti_aliasing);
+/* Draws and clears another context sharing the font atlas, e.g. one composited offscreen */
+NK_API void                 nk_sdl_render_context(struct nk_context *ctx, enum nk_anti_aliasing);
 NK_API void                 nk_sdl_shutdown(void);
 NK_API void                 nk_sdl_handle_grab(void);
 
@@ -84,6 +86,15 @@ nk_sdl_device_upload_atlas(const void *image, int width, int height)
 
 NK_API void
 nk_sdl_render(enum nk_anti_aliasing AA)
+{
+    Uint64 now = SDL_GetTicks64();
+    sdl.ctx.delta_time_seconds = (float)(now - sdl.time_of_last_frame) / 1000;
+    sdl.time_of_last_frame = now;
+    nk_sdl_render_context(&sdl.ctx, AA);
+}
+
+NK_API void
+nk_sdl_render_context(struct nk_context *ctx, enum nk_anti_aliasing AA)
 {
     /* setup global state */
     struct nk_sdl_device *dev = &sdl.ogl;
@@ -113,10 +124,6 @@ nk_sdl_render(enum nk_anti_aliasing AA)
             {NK_VERTEX_LAYOUT_END}
         };
 
-        Uint64 now = SDL_GetTicks64();
-        sdl.ctx.delta_time_seconds = (float)(now - sdl.time_of_last_frame) / 1000;
-        sdl.time_of_last_frame = now;
-
         NK_MEMSET(&config, 0, sizeof(config));
         config.vertex_layout = vertex_layout;
         config.vertex_size = sizeof(struct nk_sdl_vertex);
@@ -132,7 +139,7 @@ nk_sdl_render(enum nk_anti_aliasing AA)
         /* convert shapes into vertexes */
         nk_buffer_init_default(&vbuf);
         nk_buffer_init_default(&ebuf);
-        nk_convert(&sdl.ctx, &dev->cmds, &vbuf, &ebuf, &config);
+        nk_convert(ctx, &dev->cmds, &vbuf, &ebuf, &config);
 
         /* iterate over and execute each draw command */
         offset = (const nk_draw_index*)nk_buffer_memory_const(&ebuf);
@@ -143,7 +150,7 @@ nk_sdl_render(enum nk_anti_aliasing AA)
         SDL_RenderGetViewport(sdl.renderer, &viewport);
 #endif
 
-        nk_draw_foreach(cmd, &sdl.ctx, &dev->cmds)
+        nk_draw_foreach(cmd, ctx, &dev->cmds)
         {
             if (!cmd->elem_count) continue;
 
@@ -192,7 +199,7 @@ nk_sdl_render(enum nk_anti_aliasing AA)
             SDL_RenderSetClipRect(sdl.renderer, NULL);
         }
 
-        nk_clear(&sdl.ctx);
+        nk_clear(ctx);
         nk_buffer_clear(&dev->cmds);
         nk_buffer_free(&vbuf);
         nk_buffer_free(&ebuf);
@@ -11,12 +11,15 @@
 #include <vector>
 #include <cstdint>
 #include <sstream>
-#ifdef HAVE_LZMA
-#include <lzma.h>
-#endif
+#include <chrono>
 #include "../../fonts/InterVariable.h"
 #include "../../images/banner.h"
 #include "../../framework/nuklear_sdl_renderer.h"
+#include "core/InstallManifest.h"
+#include "core/Trash.h"
+#include "core/StagedInstall.h"
+#include "core/Extractor.h"
+#include "core/Patch.h"
 
 #pragma comment(lib, "dwmapi.lib")
 
@@ -123,16 +126,8 @@ bool InstallerWindow::initialize() {
         return false;
     }
 
-    {
-        int render_w, render_h;
-        int window_w, window_h;
-        float scale_x, scale_y;
-        SDL_GetRendererOutputSize(renderer, &render_w, &render_h);
-        SDL_GetWindowSize(window, &window_w, &window_h);
-        scale_x = (float)(render_w) / (float)(window_w);
-        scale_y = (float)(render_h) / (float)(window_h);
-        SDL_RenderSetScale(renderer, scale_x, scale_y);
-    }
+    updateRenderScale();
+    staticLayerSupported = SDL_RenderTargetSupported(renderer) == SDL_TRUE;
 
     if (!loadBackgroundImage()) {
         std::cerr << "Failed to load background image" << std::endl;
@@ -243,6 +238,77 @@ bool InstallerWindow::loadBackgroundImage() {
     return true;
 }
 
+void InstallerWindow::updateRenderScale() {
+    int render_w, render_h;
+    int window_w, window_h;
+    float scale_x, scale_y;
+    SDL_GetRendererOutputSize(renderer, &render_w, &render_h);
+    SDL_GetWindowSize(window, &window_w, &window_h);
+    scale_x = (float)(render_w) / (float)(window_w);
+    scale_y = (float)(render_h) / (float)(window_h);
+    SDL_RenderSetScale(renderer, scale_x, scale_y);
+}
+
+void InstallerWindow::drawStaticLayer(struct nk_context* target) {
+    if (backgroundTexture) {
+        SDL_Rect imageRect = {0, 0, WINDOW_WIDTH, IMAGE_HEIGHT + TITLEBAR_HEIGHT};
+        SDL_RenderCopy(renderer, backgroundTexture, NULL, &imageRect);
+    }
+
+    struct nk_style_window titlebar_style = target->style.window;
+    target->style.window.fixed_background = nk_style_item_color(nk_rgba(0, 0, 0, 0));
+    target->style.window.padding = nk_vec2(10, 4);
+
+    if (nk_begin(target, "Titlebar", nk_rect(0, 0, WINDOW_WIDTH, TITLEBAR_HEIGHT),
+                NK_WINDOW_NO_SCROLLBAR)) {
+        nk_layout_row_begin(target, NK_STATIC, TITLEBAR_HEIGHT - 4, 3);
+        nk_layout_row_push(target, WINDOW_WIDTH - 138 - 0);
+        nk_label(target, "MikoIDE Installer 0.1.2", NK_TEXT_LEFT);
+        nk_layout_row_end(target);
+    }
+    nk_end(target);
+
+    target->style.window = titlebar_style;
+}
+
+bool InstallerWindow::buildStaticLayer() {
+    // The layer is allocated at output resolution so HiDPI scaling is baked in once
+    float scale_x, scale_y;
+    SDL_RenderGetScale(renderer, &scale_x, &scale_y);
+    int layer_w = (int)(WINDOW_WIDTH * scale_x + 0.5f);
+    int layer_h = (int)((IMAGE_HEIGHT + TITLEBAR_HEIGHT) * scale_y + 0.5f);
+    staticLayer = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, layer_w, layer_h);
+    if (!staticLayer) {
+        std::cerr << "Failed to create static layer: " << SDL_GetError() << std::endl;
+        staticLayerSupported = false;
+        return false;
+    }
+    SDL_SetTextureBlendMode(staticLayer, SDL_BLENDMODE_NONE);
+    if (!staticCtxReady) {
+        // Same font and style as the live context; it never sees input
+        nk_init_default(&staticCtx, ctx->style.font);
+        staticCtx.style = ctx->style;
+        staticCtxReady = true;
+    }
+
+    // Switching targets resets the scale to 1, so reapply it for the layer's pixels
+    SDL_SetRenderTarget(renderer, staticLayer);
+    SDL_RenderSetScale(renderer, scale_x, scale_y);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderClear(renderer);
+    drawStaticLayer(&staticCtx);
+    nk_sdl_render_context(&staticCtx, NK_ANTI_ALIASING_ON);
+    SDL_SetRenderTarget(renderer, NULL);
+    return true;
+}
+
+void InstallerWindow::invalidateStaticLayer() {
+    if (staticLayer) {
+        SDL_DestroyTexture(staticLayer);
+        staticLayer = nullptr;
+    }
+}
+
 void InstallerWindow::handleWindowControls(int mouseX, int mouseY, bool clicked) {
     int buttonWidth = 46;
     int buttonHeight = TITLEBAR_HEIGHT;
@@ -343,91 +409,105 @@ void InstallerWindow::openFolderDialog() {
 void InstallerWindow::performInstallation() {
     // Begin installation; if self-contained payload exists, extraction happens here.
     installProgress.store(0.0f);
+    installFailed.store(false);
+    installSwapped.store(false);
+    failureReason.clear();
 
     std::cout << "Installing MikoIDE to: " << installPath << std::endl;
-    if (hasEmbeddedPayload()) {
+    // A background uninstall that was interrupted may have left a trash folder next to us
+    Trash::sweepLeftovers(installPath);
+    PayloadReader payload;
+    if (payload.open(modulePath())) {
+        if (payload.section(MIKO_SECTION_PATCH)) {
+            // Patch payloads only carry what changed; the Patcher stages the new version next
+            // to installPath and swaps it in whole
+            std::cout << "Found patch payload. Updating existing installation..." << std::endl;
+            Patcher patcher(payload, std::filesystem::path(installPath));
+            ExtractOptions opts;
+            opts.cancel = &cancelRequested;
+            opts.progress = &installProgress;
+            opts.durability = durability;
+            bool patchOk = patcher.apply(opts);
+            if (!patchOk) {
+                std::cerr << "Patch failed: " << patcher.error() << std::endl;
+                installSwapped.store(patcher.swapped());
+                installFailed.store(true);
+            }
+            return;
+        }
         std::cout << "Found embedded payload. Extracting..." << std::endl;
-        // Minimal streamed copy to buffer to simulate extraction work
-        char exePath[MAX_PATH];
-        GetModuleFileNameA(NULL, exePath, MAX_PATH);
-        std::ifstream f(exePath, std::ios::binary);
-        if (f) {
-            f.seekg(0, std::ios::end);
-            auto size = f.tellg();
-            f.seekg(size - (std::streamoff)(8*3), std::ios::beg);
-            uint64_t blob_size=0, meta_size=0, magic_off=0;
-            f.read(reinterpret_cast<char*>(&blob_size), 8);
-            f.read(reinterpret_cast<char*>(&meta_size), 8);
-            f.read(reinterpret_cast<char*>(&magic_off), 8);
-            f.seekg(magic_off + MIKO_MAGIC_LEN, std::ios::beg);
-            char algo[MIKO_ALGO_LEN];
-            f.read(algo, MIKO_ALGO_LEN);
-            std::vector<uint8_t> blob(blob_size);
-            f.read(reinterpret_cast<char*>(blob.data()), blob.size());
-            std::vector<uint8_t> tar;
-#ifdef HAVE_LZMA
-            if (memcmp(algo, "LZMA", 4) == 0) {
-                lzma_stream strm = LZMA_STREAM_INIT;
-                if (lzma_auto_decoder(&strm, UINT64_MAX, 0) == LZMA_OK) {
-                    strm.next_in = blob.data();
-                    strm.avail_in = (size_t)blob.size();
-                    std::vector<uint8_t> chunk(256 * 1024);
-                    lzma_ret ret = LZMA_OK;
-                    while (ret == LZMA_OK) {
-                        tar.resize(tar.size() + chunk.size());
-                        strm.next_out = tar.data() + (tar.size() - chunk.size());
-                        strm.avail_out = (size_t)chunk.size();
-                        ret = lzma_code(&strm, LZMA_RUN);
-                        size_t produced = chunk.size() - strm.avail_out;
-                        tar.resize(tar.size() - chunk.size() + produced);
-                        // UI: bump progress a bit to avoid perceived freeze during long decompression
-                        float cur = installProgress.load();
-                        installProgress.store(std::min(0.90f, cur + 0.02f));
-                    }
-                    if (ret != LZMA_STREAM_END) {
-                        tar.clear();
-                    }
-                    lzma_end(&strm);
-                }
+        InstallPlan plan;
+        if (payload.plan(plan)) {
+            // Refuse up front rather than fail after decompressing most of the payload
+            std::filesystem::path probe = std::filesystem::path(installPath);
+            std::error_code ec;
+            while (!probe.empty() && !std::filesystem::exists(probe, ec) && probe.has_relative_path()) {
+                probe = probe.parent_path();
             }
-#endif
-            // Fallback: assume already raw tar if decoding failed
-            if (tar.empty()) {
-                tar.assign(blob.begin(), blob.end());
+            std::filesystem::space_info space = std::filesystem::space(probe, ec);
+            std::cout << plan.fileCount << " files, " << plan.totalBytes / (1024 * 1024) << " MiB to write" << std::endl;
+            if (!ec && space.available < plan.totalBytes) {
+                std::ostringstream msg;
+                msg << "Not enough disk space: " << plan.totalBytes / (1024 * 1024) << " MiB needed, "
+                    << space.available / (1024 * 1024) << " MiB available.";
+                std::cerr << msg.str() << std::endl;
+                failureReason = msg.str();
+                installFailed.store(true);
+                return;
             }
-            // Extract tar entries
-            std::error_code ec;
-            std::filesystem::create_directories(installPath, ec);
-            auto rd = [&](const void* p, size_t n)->uint64_t { return 0; };
-            // Minimal tar read loop
-            size_t off = 0; size_t total = tar.size();
-            auto clamp = [](long long v, long long lo, long long hi){ return v<lo?lo:(v>hi?hi:v); };
-            while (off + 512 <= total) {
-                const uint8_t* hdr = tar.data() + off;
-                bool empty = true; for (int i=0;i<512;i++){ if(hdr[i]){ empty=false; break;} }
-                if (empty) break;
-                char name[101]={0}; memcpy(name, hdr, 100);
-                char size_oct[13]={0}; memcpy(size_oct, hdr+124, 12);
-                size_t fsize = strtoull(size_oct, nullptr, 8);
-                size_t data_off = off + 512;
-                std::filesystem::path out = std::filesystem::path(installPath) / name;
-                std::string nstr(name);
-                if (!nstr.empty() && nstr.back()=='/') {
-                    std::filesystem::create_directories(out, ec);
-                } else {
-                    std::filesystem::create_directories(out.parent_path(), ec);
-                    std::ofstream fo(out, std::ios::binary);
-                    if (fo) {
-                        fo.write((const char*)(tar.data()+data_off), fsize);
-                    }
-                }
-                size_t blocks = (fsize + 511)/512;
-                off = data_off + blocks*512;
-                // update progress
-                installProgress.store((float)clamp((long long)off*100LL/(long long)total, 0, 100) / 100.0f);
-                // Progress is atomic and UI polls it on the main thread.
+        }
+        // Extract into a staging sibling; installPath is only replaced once every entry
+        // has been written
+        StagedInstall stage{std::filesystem::path(installPath), durability};
+        if (!stage.replaceable()) {
+            // A folder that is neither empty nor an earlier install would be swapped away whole
+            failureReason = "The install folder is not empty and holds no MikoIDE installation; choose an empty folder.";
+            std::cerr << failureReason << std::endl;
+            installFailed.store(true);
+            return;
+        }
+        if (!stage.begin()) {
+            std::cerr << "Failed to create staging directory next to " << installPath << std::endl;
+            installFailed.store(true);
+            return;
+        }
+        Extractor extractor(payload, stage.stagingPath());
+        ExtractOptions opts;
+        opts.cancel = &cancelRequested;
+        opts.progress = &installProgress;
+        opts.durability = durability;
+        bool extractOk = extractor.run(opts);
+        if (!extractOk) {
+            std::cerr << "Extraction failed: " << extractor.error() << std::endl;
+        }
+        // Lets the uninstaller remove exactly what was created
+        if (extractOk && !extractor.manifest().save(stage.stagingPath() / MIKO_MANIFEST_FILE)) {
+            std::cerr << "Failed to write install manifest" << std::endl;
+            extractOk = false;
+        }
+        if (extractOk && durability != Durability::None) {
+            syncFile(stage.stagingPath() / MIKO_MANIFEST_FILE);
+        }
+        if (!extractOk) {
+            // Nothing under installPath was touched; dropping the staging tree is one rename
+            stage.rollback();
+            installFailed.store(true);
+            return;
+        }
+        if (!stage.commit()) {
+            if (stage.swapped()) {
+                // Already in place: there is no staged tree left to roll back
+                std::cerr << "Failed to flush the swap into " << installPath << std::endl;
+                failureReason = "The new version could not be flushed to disk; restart before using it.";
+                installSwapped.store(true);
+            } else {
+                std::cerr << "Failed to move staged install into " << installPath << std::endl;
+                stage.rollback();
             }
+            installFailed.store(true);
+            return;
         }
+        std::cout << "Swapped staged install into place in " << stage.lastSwapSeconds() * 1000.0 << " ms" << std::endl;
     } else {
         std::cout << "No embedded payload found; running in config UI mode." << std::endl;
     }
@@ -439,35 +519,35 @@ void InstallerWindow::startExtractionAsync() {
     }
     workerFinished.store(false);
     worker = std::thread([this]() {
+        auto start = std::chrono::steady_clock::now();
         try {
             performInstallation();
         } catch (...) {
-            // TODO: capture error state
+            installFailed.store(true);
         }
+        installDurationMs.store((uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count());
         workerFinished.store(true);
     });
 }
 
-bool InstallerWindow::hasEmbeddedPayload() const {
-    char exePath[MAX_PATH];
-    GetModuleFileNameA(NULL, exePath, MAX_PATH);
-    std::ifstream f(exePath, std::ios::binary);
-    if (!f) return false;
-    f.seekg(0, std::ios::end);
-    auto size = f.tellg();
-    if (size < 8*3 + MIKO_MAGIC_LEN) return false;
-    // Read trailer
-    f.seekg(size - (std::streamoff)(8*3), std::ios::beg);
-    uint64_t blob_size=0, meta_size=0, magic_off=0;
-    f.read(reinterpret_cast<char*>(&blob_size), 8);
-    f.read(reinterpret_cast<char*>(&meta_size), 8);
-    f.read(reinterpret_cast<char*>(&magic_off), 8);
-    if (magic_off + MIKO_MAGIC_LEN + MIKO_ALGO_LEN + blob_size + meta_size + 8*3 != (uint64_t)size) return false;
-    f.seekg(magic_off, std::ios::beg);
-    char mg[MIKO_MAGIC_LEN];
-    f.read(mg, MIKO_MAGIC_LEN);
-    if (memcmp(mg, MIKO_MAGIC, MIKO_MAGIC_LEN) != 0) return false;
-    return true;
+std::filesystem::path InstallerWindow::modulePath() {
+    wchar_t exePath[MAX_PATH];
+    GetModuleFileNameW(NULL, exePath, MAX_PATH);
+    return std::filesystem::path(exePath);
+}
+
+void InstallerWindow::updateWindowVisibility() {
+    Uint32 flags = SDL_GetWindowFlags(window);
+    bool visible = !(flags & (SDL_WINDOW_HIDDEN | SDL_WINDOW_MINIMIZED));
+    if (visible && hwnd) {
+        // Cloaked windows (other virtual desktop, shell occlusion) are not composed by DWM
+        DWORD cloaked = 0;
+        if (SUCCEEDED(DwmGetWindowAttribute(hwnd, DWMWA_CLOAKED, &cloaked, sizeof(cloaked))) && cloaked) {
+            visible = false;
+        }
+    }
+    windowVisible = visible;
 }
 
 void InstallerWindow::run() {
@@ -476,11 +556,41 @@ void InstallerWindow::run() {
     int dragStartX = 0, dragStartY = 0;
 
     while (running) {
+        if (!windowVisible) {
+            // Nothing is on screen: sleep until an event arrives instead of spinning on a
+            // present that no longer blocks on vsync, leaving the CPU to the extraction worker.
+            // The timeout only bounds how late an uncloak (which sends no event) is noticed.
+            SDL_WaitEventTimeout(nullptr, 250);
+        }
         nk_input_begin(ctx);
         while (SDL_PollEvent(&e)) {
             if (e.type == SDL_QUIT) {
-                exitCode = 2; // canceled/closed
-                running = false;
+                cancel(); // canceled/closed
+            }
+            else if (e.type == SDL_WINDOWEVENT) {
+                switch (e.window.event) {
+                    case SDL_WINDOWEVENT_HIDDEN:
+                    case SDL_WINDOWEVENT_MINIMIZED:
+                        windowVisible = false;
+                        break;
+                    case SDL_WINDOWEVENT_SHOWN:
+                    case SDL_WINDOWEVENT_RESTORED:
+                    case SDL_WINDOWEVENT_MAXIMIZED:
+                    case SDL_WINDOWEVENT_EXPOSED:
+                    case SDL_WINDOWEVENT_FOCUS_GAINED:
+                        updateWindowVisibility();
+                        break;
+                    case SDL_WINDOWEVENT_SIZE_CHANGED:
+                    case SDL_WINDOWEVENT_DISPLAY_CHANGED:
+                        // Output size or DPI may differ: rescale and re-composite the static layer
+                        updateRenderScale();
+                        invalidateStaticLayer();
+                        break;
+                }
+            }
+            else if (e.type == SDL_RENDER_TARGETS_RESET || e.type == SDL_RENDER_DEVICE_RESET) {
+                // Target contents are lost when the device is reset
+                invalidateStaticLayer();
             }
             else if (e.type == SDL_MOUSEBUTTONDOWN) {
                 if (e.button.button == SDL_BUTTON_LEFT) {
@@ -513,28 +623,25 @@ void InstallerWindow::run() {
         nk_sdl_handle_grab();
         nk_input_end(ctx);
 
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-        SDL_RenderClear(renderer);
+        updateWindowVisibility();
+        if (!windowVisible) {
+            // Completion is picked up by the progress panel once the window is shown again
+            continue;
+        }
 
-        if (backgroundTexture) {
-            SDL_Rect imageRect = {0, 0, WINDOW_WIDTH, IMAGE_HEIGHT + TITLEBAR_HEIGHT};
-            SDL_RenderCopy(renderer, backgroundTexture, NULL, &imageRect);
+        if (!staticLayer && staticLayerSupported) {
+            buildStaticLayer();
         }
 
-        struct nk_style_window titlebar_style = ctx->style.window;
-        ctx->style.window.fixed_background = nk_style_item_color(nk_rgba(0, 0, 0, 0));
-        ctx->style.window.padding = nk_vec2(10, 4);
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+        SDL_RenderClear(renderer);
 
-        if (nk_begin(ctx, "Titlebar", nk_rect(0, 0, WINDOW_WIDTH, TITLEBAR_HEIGHT),
-                    NK_WINDOW_NO_SCROLLBAR)) {
-            nk_layout_row_begin(ctx, NK_STATIC, TITLEBAR_HEIGHT - 4, 3);
-            nk_layout_row_push(ctx, WINDOW_WIDTH - 138 - 0);
-            nk_label(ctx, "MikoIDE Installer 0.1.2", NK_TEXT_LEFT);
-            nk_layout_row_end(ctx);
+        if (staticLayer) {
+            SDL_Rect layerRect = {0, 0, WINDOW_WIDTH, IMAGE_HEIGHT + TITLEBAR_HEIGHT};
+            SDL_RenderCopy(renderer, staticLayer, NULL, &layerRect);
+        } else {
+            drawStaticLayer(ctx);
         }
-        nk_end(ctx);
-
-        ctx->style.window = titlebar_style;
 
         int panelY = IMAGE_HEIGHT + TITLEBAR_HEIGHT;
         if (nk_begin(ctx, "Installer Panel", nk_rect(0, panelY, WINDOW_WIDTH, PANEL_HEIGHT),
@@ -566,7 +673,6 @@ void InstallerWindow::run() {
                     // Start non-blocking extraction on a worker thread
                     isInstalling = true;
                     installDone = false;
-                    installStartTicks = SDL_GetTicks();
                     installProgress.store(0.0f);
                     workerFinished.store(false);
                     startExtractionAsync();
@@ -602,12 +708,25 @@ void InstallerWindow::run() {
                 if (workerFinished.load()) {
                     isInstalling = false;
                     installDone = true;
-                    installDurationMs = SDL_GetTicks() - installStartTicks;
-                    std::cout << "Installation completed successfully!" << std::endl;
+                    std::cout << (installFailed.load() ? "Installation failed." : "Installation completed successfully!") << std::endl;
+                }
+            } else if (installDone && installFailed.load()) {
+                nk_layout_row_dynamic(ctx, 25, 1);
+                nk_label(ctx, installSwapped.load() ? "Installation failed after the new version was put in place."
+                                                    : "Installation failed. The previous installation was left unchanged.",
+                         NK_TEXT_LEFT);
+                if (!failureReason.empty()) {
+                    nk_layout_row_dynamic(ctx, 25, 1);
+                    nk_label(ctx, failureReason.c_str(), NK_TEXT_LEFT);
+                }
+                nk_layout_row_dynamic(ctx, 35, 1);
+                if (nk_button_label(ctx, "Close")) {
+                    exitCode = 1;
+                    running = false;
                 }
             } else if (installDone) {
                 nk_layout_row_dynamic(ctx, 25, 1);
-                nk_label(ctx, "MikoIDE has been installed.", NK_TEXT_LEFT);
+                nk_labelf(ctx, NK_TEXT_LEFT, "MikoIDE has been installed in %.1f s.", installDurationMs.load() / 1000.0);
                 nk_layout_row_dynamic(ctx, 35, 1);
                 if (nk_button_label(ctx, "OK")) {
                     // Persist selection for NSIS via provided --config path or fallback
@@ -642,10 +761,15 @@ void InstallerWindow::cleanup() {
     if (worker.joinable()) {
         try { worker.join(); } catch(...) {}
     }
+    invalidateStaticLayer();
     if (backgroundTexture) {
         SDL_DestroyTexture(backgroundTexture);
         backgroundTexture = nullptr;
     }
+    if (staticCtxReady) {
+        nk_free(&staticCtx);
+        staticCtxReady = false;
+    }
     if (ctx) {
         nk_sdl_shutdown();
         ctx = nullptr;
@@ -14,7 +14,9 @@
 #define NK_INCLUDE_DEFAULT_FONT
 #include "framework/nuklear.h"
 #include "format.h"
+#include "core/Durability.h"
 #include <atomic>
+#include <filesystem>
 #include <thread>
 
 class InstallerWindow {
@@ -27,8 +29,13 @@ public:
     void cleanup();
     void setConfigPath(const std::string& path) { configPath = path; }
     int getExitCode() const { return exitCode; }
-    void cancel() { exitCode = 2; running = false; }
+    void cancel() { exitCode = 2; running = false; cancelRequested = true; }
     void setProgressFile(const std::string& path) { progressFile = path; progressMode = !path.empty(); }
+    void setDurability(Durability d) { durability = d; }
+
+    static std::string getExpandedInstallPath();
+    // Path of the running executable, which carries the payload
+    static std::filesystem::path modulePath();
 
     // Public state accessed by WindowProc
     bool running;
@@ -42,6 +49,13 @@ private:
     struct nk_font* iconFont;
     HWND hwnd;
     SDL_Texture* backgroundTexture;
+    // Banner + title bar composited once into a render target and blitted every frame. The
+    // title bar is laid out in a context of its own: rendering clears a context, and
+    // clearing the live one would drop the panel's window state.
+    SDL_Texture* staticLayer = nullptr;
+    bool staticLayerSupported = true;
+    struct nk_context staticCtx;
+    bool staticCtxReady = false;
 
     // UI state
     std::string installPath;
@@ -52,11 +66,20 @@ private:
     bool isInstalling = false;
     bool installDone = false;
     std::atomic<float> installProgress = 0.0f; // 0..1
-    Uint32 installStartTicks = 0;
-    Uint32 installDurationMs = 0; // simulated duration
+    // Set by the worker: from the start of extraction until it completed or failed
+    std::atomic<uint32_t> installDurationMs = 0;
+
+    // Rendering is paused while the window is hidden, minimized or cloaked
+    bool windowVisible = true;
 
     std::thread worker;
     std::atomic<bool> workerFinished = false;
+    std::atomic<bool> installFailed = false;
+    // The new version replaced the old one, but the swap could not be flushed to disk
+    std::atomic<bool> installSwapped = false;
+    // Set by the worker before installFailed; read by the UI once the worker has finished
+    std::string failureReason;
+    std::atomic<bool> cancelRequested = false;
 
     // Window control state
     bool isMaximized;
@@ -68,16 +91,20 @@ private:
     int exitCode = 1; // 0=success, non-zero=cancel/error
     bool progressMode = false;
     std::string progressFile;
+    Durability durability = Durability::None;
 
 private:
-    std::string getExpandedInstallPath();
     void setupCustomStyle();
     bool loadBackgroundImage();
+    void updateRenderScale();
+    void drawStaticLayer(struct nk_context* target);
+    bool buildStaticLayer();
+    void invalidateStaticLayer();
     void handleWindowControls(int mouseX, int mouseY, bool clicked);
     void openFolderDialog();
     void performInstallation();
     void startExtractionAsync();
-    bool hasEmbeddedPayload() const;
+    void updateWindowVisibility();
 };
 
 // Window procedure to handle native Windows messages
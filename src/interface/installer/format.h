@@ -4,11 +4,66 @@
 // Layout in output EXE:
 // [bootstrap exe bytes]
 // magic: "MIKOSETUP\0" (10 bytes)
-// algo: 4 ASCII bytes (e.g., "LZMA" or "NONE")
-// blob: compressed or raw TAR bytes (size = blob_size from trailer)
+// algo: 4 ASCII bytes: "BLKS", or "LZMA"/"NONE" from older packers
+// blob: TAR bytes (size = blob_size from trailer). For "BLKS" the TAR is cut into blocks
+//   coded independently and stored back to back; BIDX gives each block's codec:
+//   "STOR" raw bytes, "DFLT" a zlib stream, "LZMA" an .xz stream
+//   (executables carry an x86/ARM64/RISC-V BCJ filter in their .xz block headers),
+//   "DFZD" a zlib stream whose preset dictionary is the DICT section.
+//   "LZMA" is one or more concatenated .xz streams, "NONE" the raw TAR
+// sections: tagged binary tables (size = sections_size from trailer), each one
+//   tag: 4 ASCII bytes, reserved: uint32, size: uint64, then `size` bytes
 // meta: TOML bytes (size = meta_size from trailer)
-// trailer: 3x uint64 little-endian: blob_size, meta_size, magic_offset
+// trailer: 4x uint64 little-endian: blob_size, sections_size, meta_size, magic_offset
+//
+// Sections (integers little-endian, paths UTF-8 and '/' separated as named in the TAR):
+// "HASH": uint64 count, then per regular file:
+//         uint64 size, 32-byte SHA-256 of the contents, uint16 path length, path
+// "BIDX": uint64 count, then per block in blob order: uint64 offset within the blob,
+//         uint64 compressed size, uint64 uncompressed size, 4-byte codec, uint32 flags.
+//         MIKO_BLOCK_ENTRY_START marks a block that begins on a TAR header; it and the
+//         unmarked blocks after it unpack without any earlier block, so the installer
+//         extracts such runs in parallel. Older packers wrote 0 (one sequential run).
+//         MIKO_BLOCK_ENTRY_ALIGNED marks a block placed for mapping: a "STOR" block whose
+//         first entry's data, or any other block itself, starts on a MIKO_PAGE_ALIGN
+//         boundary of the setup file. Zero padding before such a block is not covered by
+//         any entry; offsets are always read from the index, never summed.
+// "PLAN": uint64 file_count, uint64 total file bytes, uint64 largest file size,
+//         uint64 uncompressed TAR size, uint64 dir_count, then per directory in TAR order:
+//         uint16 path length, path. Together with BIDX this lets the installer check disk
+//         space, create directories and report exact progress before decoding the blob.
+// "PTCH": present only in patch payloads, which update an existing install in place.
+//         uint64 count, then per file a delta reads, as installed by the base version:
+//           uint64 size, 32-byte SHA-256, uint16 path length, path (the HASH layout);
+//         uint64 count, then per file removed since the base: uint16 path length, path.
+//         The TAR carries changed files whole, and modified large ones as a delta entry
+//         named MIKO_DELTA_PREFIX + path. HASH still describes the complete new tree.
+// "DICT": present when any block is "DFZD": up to 32 KiB of zlib preset dictionary,
+//         trained by the packer on the payload's small text files.
+//
+// Delta entries (integers little-endian):
+// magic: "MIKODLT1", uint64 base_size, uint64 target_size, then operations until the end:
+//   uint8 1 (COPY), uint64 base offset, uint64 length
+//   uint8 2 (ADD), uint64 length, then `length` literal bytes
 
 static const char MIKO_MAGIC[10] = {'M','I','K','O','S','E','T','U','P','\0'};
 static const int MIKO_MAGIC_LEN = 10;
-static const int MIKO_ALGO_LEN = 4; // "LZMA" or "NONE"
+static const int MIKO_ALGO_LEN = 4; // "BLKS", "LZMA" or "NONE"
+static const char MIKO_ALGO_BLOCKS[4] = {'B','L','K','S'};
+static const int MIKO_BLOCK_ENTRY_LEN = 32;
+static const int MIKO_BLOCK_ENTRY_START = 1; // BIDX flags
+static const int MIKO_BLOCK_ENTRY_ALIGNED = 2;
+static const int MIKO_PAGE_ALIGN = 4096;
+static const char MIKO_CODEC_STORE[4] = {'S','T','O','R'};
+static const char MIKO_CODEC_DEFLATE[4] = {'D','F','L','T'};
+static const char MIKO_CODEC_LZMA[4] = {'L','Z','M','A'};
+static const char MIKO_CODEC_DEFLATE_DICT[4] = {'D','F','Z','D'};
+static const int MIKO_TRAILER_LEN = 8 * 4;
+static const int MIKO_SECTION_HEADER_LEN = 16;
+static const char MIKO_SECTION_HASH[4] = {'H','A','S','H'};
+static const char MIKO_SECTION_BLOCKS[4] = {'B','I','D','X'};
+static const char MIKO_SECTION_PLAN[4] = {'P','L','A','N'};
+static const char MIKO_SECTION_PATCH[4] = {'P','T','C','H'};
+static const char MIKO_SECTION_DICT[4] = {'D','I','C','T'};
+static const char MIKO_DELTA_MAGIC[8] = {'M','I','K','O','D','L','T','1'};
+static const char MIKO_DELTA_PREFIX[] = ".miko-delta/";
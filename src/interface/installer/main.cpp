@@ -1,19 +1,85 @@
 // Thin entry point that uses the split InstallerWindow class.
 #include <iostream>
 #include "InstallerWindow.h"
+#include "core/Verifier.h"
 #include <string>
+#include <cstdio>
+
+// --verify / --repair run headless against an existing installation
+static int runMaintenance(bool repair, const std::string& installDir, unsigned threads, Durability durability) {
+    // GUI-subsystem builds have no console of their own; report into the caller's
+    if (AttachConsole(ATTACH_PARENT_PROCESS)) {
+        FILE* f = nullptr;
+        freopen_s(&f, "CONOUT$", "w", stdout);
+        freopen_s(&f, "CONOUT$", "w", stderr);
+    }
+    PayloadReader payload;
+    if (!payload.open(InstallerWindow::modulePath())) {
+        std::cerr << "No embedded payload; nothing to verify against." << std::endl;
+        return 3;
+    }
+    std::vector<PayloadFileHash> expected = payload.fileHashes();
+    if (expected.empty()) {
+        std::cerr << "Payload carries no file hashes; repack with a current pack.py." << std::endl;
+        return 3;
+    }
+
+    std::filesystem::path root(installDir);
+    Verifier verifier(threads);
+    VerifyReport report = verifier.verify(root, expected);
+    std::cout << "Checked " << report.filesChecked << " files (" << report.bytesHashed / (1024 * 1024)
+              << " MiB hashed) in " << report.seconds << " s" << std::endl;
+    for (const auto& issue : report.issues) {
+        std::cout << "  " << verifyIssueName(issue.kind) << ": " << issue.path << std::endl;
+    }
+    if (report.clean()) {
+        std::cout << "Installation is intact." << std::endl;
+        return 0;
+    }
+    std::cout << report.issues.size() << " damaged or missing files." << std::endl;
+    if (!repair) return 1;
+
+    std::string error;
+    if (!verifier.repair(payload, root, report, &error, durability)) {
+        std::cerr << "Repair failed: " << error << std::endl;
+        return 1;
+    }
+    VerifyReport after = verifier.verify(root, expected);
+    std::cout << (after.clean() ? "Repaired." : "Some files are still damaged.") << std::endl;
+    return after.clean() ? 0 : 1;
+}
 
 int main(int argc, char* argv[]) {
     InstallerWindow app;
-    // Parse --config <path> and --progress-file <path>
+    bool verify = false, repair = false;
+    std::string installDir;
+    unsigned threads = 0;
+    Durability durability = Durability::None;
+    // Parse --config <path>, --progress-file <path>, --durability <none|file|end|barriers> and the
+    // --verify/--repair maintenance flags
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
         if (arg == "--config" && i + 1 < argc) {
             app.setConfigPath(argv[++i]);
         } else if (arg == "--progress-file" && i + 1 < argc) {
             app.setProgressFile(argv[++i]);
+        } else if (arg == "--verify") {
+            verify = true;
+        } else if (arg == "--repair") {
+            repair = true;
+        } else if (arg == "--install-dir" && i + 1 < argc) {
+            installDir = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--durability" && i + 1 < argc) {
+            if (parseDurability(argv[++i], durability)) app.setDurability(durability);
+            else std::cerr << "Unknown durability: " << argv[i] << std::endl;
         }
     }
+    if (verify || repair) {
+        return runMaintenance(repair, installDir.empty() ? InstallerWindow::getExpandedInstallPath() : installDir, threads,
+                              durability);
+    }
     if (!app.initialize()) {
         std::cerr << "Failed to initialize installer!" << std::endl;
         return -1;
@@ -27,4 +93,4 @@ int main(int argc, char* argv[]) {
     // when it sets --progress-file.
     app.run();
     return app.getExitCode();
-}
\ No newline at end of file
+}
@@ -4,8 +4,10 @@
 #include <algorithm>
 #include <dwmapi.h>
 #include <filesystem>
+#include <chrono>
 #include "fonts/InterVariable.h"
 #include "framework/nuklear_sdl_renderer.h"
+#include "core/Trash.h"
 
 #ifndef DWMWA_WINDOW_CORNER_PREFERENCE
 #define DWMWA_WINDOW_CORNER_PREFERENCE 33
@@ -83,6 +85,8 @@ bool UninstallerWindow::initialize() {
         if (font) nk_style_set_font(ctx, &font->handle);
     }
     setupCustomStyle();
+    // Finish whatever a previous background delete left behind
+    Trash::sweepLeftovers(installPath);
     running = true; return true;
 }
 
@@ -111,7 +115,9 @@ void UninstallerWindow::setupCustomStyle() {
 
 void UninstallerWindow::startUninstallAsync() {
     if (uninstalling) return;
-    uninstallOk = false; uninstallFailed = false; progress = 0; uninstalling = true; lastAction.clear();
+    // A finished run (Retry after a failure) leaves its thread joinable; reassigning it would terminate
+    if (worker.joinable()) worker.join();
+    uninstallOk = false; uninstallFailed = false; progress = 0; uninstalling = true; lastAction.clear(); failureReason.clear();
     worker = std::thread([this]{ doUninstall(); });
 }
 
@@ -126,18 +132,72 @@ static void scheduleSelfDelete() {
     }
 }
 
+bool UninstallerWindow::deleteTree(const std::filesystem::path& root, const InstallManifest& manifest) {
+    deleting = true;
+    auto start = std::chrono::steady_clock::now();
+    bool ok = deleter.run(root, manifest);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    deleting = false;
+    std::cout << "Removed " << deleter.filesDeleted() << " files, " << deleter.dirsDeleted() << " directories in "
+              << secs << " s with " << deleter.threadCount() << " workers" << std::endl;
+    return ok;
+}
+
 void UninstallerWindow::doUninstall() {
     try {
-        // Example steps, update lastAction for UI
-        lastAction = "removing: shortcuts"; std::this_thread::sleep_for(300ms); progress = 10;
-        lastAction = "removing: file associations"; std::this_thread::sleep_for(300ms); progress = 25;
-        lastAction = "removing: PATH entries"; std::this_thread::sleep_for(300ms); progress = 40;
-        lastAction = std::string("removing: ") + installPath; std::this_thread::sleep_for(300ms); progress = 70;
-        // Pretend to remove files
-        // TODO: add real filesystem removal
-        std::this_thread::sleep_for(500ms); progress = 100;
-        uninstallOk = true;
+        std::filesystem::path root(installPath);
+        std::filesystem::path manifestFile = root / MIKO_MANIFEST_FILE;
+
+        // Without the installer's manifest nothing proves this folder is ours; never delete blind
+        std::error_code mec;
+        if (!std::filesystem::is_regular_file(manifestFile, mec)) {
+            failureReason = "No install manifest in " + installPath + "; nothing was deleted.";
+            uninstallFailed = true;
+            uninstalling = false;
+            return;
+        }
+
+        if (backgroundDelete) {
+            // One rename makes the install disappear; the reaper deletes it at idle priority
+            lastAction = "moving to trash";
+            std::filesystem::path trashed = Trash::moveToTrash(root);
+            if (!trashed.empty()) {
+                if (!Trash::spawnReaper(trashed)) {
+                    lastAction = "removing: trash";
+                    deleteTree(trashed, InstallManifest::scan(trashed));
+                    std::error_code ec;
+                    std::filesystem::remove(trashed, ec);
+                    std::filesystem::remove(trashed.parent_path(), ec);
+                    std::filesystem::remove(Trash::rootFor(root), ec);
+                }
+                progress = 100;
+                uninstallOk = true;
+                uninstalling = false;
+                return;
+            }
+            // Rename refused (files in use, permissions): delete in place instead
+        }
+
+        lastAction = "reading: install manifest";
+        InstallManifest manifest;
+        if (!manifest.load(manifestFile)) {
+            failureReason = "The install manifest could not be read; nothing was deleted.";
+            uninstallFailed = true;
+            uninstalling = false;
+            return;
+        }
+        progress = 5;
+
+        lastAction = std::string("removing: ") + installPath;
+        bool ok = deleteTree(root, manifest);
+
+        std::error_code ec;
+        std::filesystem::remove(manifestFile, ec);
+        std::filesystem::remove(root, ec); // only succeeds once nothing else is left
+        progress = 100;
+        if (ok) uninstallOk = true; else uninstallFailed = true;
     } catch (...) {
+        deleting = false;
         uninstallFailed = true;
     }
     uninstalling = false;
@@ -166,7 +226,7 @@ void UninstallerWindow::run() {
             // Progress + status text
             nk_layout_row_dynamic(ctx, 35, 1);
             if (uninstalling) {
-                nk_size cur = progress.load();
+                nk_size cur = deleting ? (nk_size)(5 + deleter.progress() * 95.0f) : progress.load();
                 nk_progress(ctx, &cur, 100, nk_false);
                 nk_layout_row_dynamic(ctx, 20, 1);
                 nk_label(ctx, lastAction.c_str(), NK_TEXT_LEFT);
@@ -179,10 +239,15 @@ void UninstallerWindow::run() {
                 }
             } else if (uninstallFailed) {
                 nk_label(ctx, "Error during uninstallation.", NK_TEXT_LEFT);
+                if (!failureReason.empty()) {
+                    nk_layout_row_dynamic(ctx, 20, 1);
+                    nk_label(ctx, failureReason.c_str(), NK_TEXT_LEFT);
+                }
                 nk_layout_row_dynamic(ctx, 35, 2);
                 if (nk_button_label(ctx, "Retry")) startUninstallAsync();
                 if (nk_button_label(ctx, "Close")) running = false;
             } else {
+                nk_checkbox_label(ctx, "remove folder in background (includes files added after install)", &backgroundDelete);
                 nk_layout_row_dynamic(ctx, 35, 2);
                 if (nk_button_label(ctx, "Uninstall")) startUninstallAsync();
                 if (nk_button_label(ctx, "Close")) running = false;
@@ -196,7 +261,7 @@ void UninstallerWindow::run() {
 }
 
 void UninstallerWindow::cleanup() {
-    if (worker.joinable()) { uninstalling = false; worker.join(); }
+    if (worker.joinable()) { deleter.cancel(); uninstalling = false; worker.join(); }
     if (ctx) { nk_sdl_shutdown(); ctx = nullptr; }
     if (renderer) { SDL_DestroyRenderer(renderer); renderer = nullptr; }
     if (window) { SDL_DestroyWindow(window); window = nullptr; }
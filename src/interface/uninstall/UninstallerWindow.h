@@ -12,6 +12,7 @@
 #define NK_INCLUDE_FONT_BAKING
 #define NK_INCLUDE_DEFAULT_FONT
 #include "framework/nuklear.h"
+#include "core/DeletionPool.h"
 
 #include <atomic>
 #include <thread>
@@ -37,20 +38,25 @@ private:
 
     // UI state
     std::string installPath;
+    nk_bool backgroundDelete = nk_false; // rename into trash and let a detached reaper delete
 
     // Uninstall state
     std::atomic<bool> uninstalling{false};
     std::atomic<size_t> progress{0};
     std::atomic<bool> uninstallOk{false};
     std::atomic<bool> uninstallFailed{false};
+    std::atomic<bool> deleting{false};
+    DeletionPool deleter;
     std::thread worker;
     std::string lastAction;
+    std::string failureReason;
 
 private:
     std::string detectInstallPath();
     void setupCustomStyle();
     void startUninstallAsync();
     void doUninstall();
+    bool deleteTree(const std::filesystem::path& root, const InstallManifest& manifest);
 };
 
 LRESULT CALLBACK UninstallWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);